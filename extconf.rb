@@ -32,6 +32,8 @@ if have_header("fontconfig/fontconfig.h")
   have_library("fontconfig", "FcInit") or exit(false)
 end
 
+have_header("sys/inotify.h")
+
 if CONFIG["arch"] =~ /mingw32/
   have_library("opengl32") or exit(false)
 elsif CONFIG["arch"] =~ /darwin/
@@ -1,8 +1,94 @@
 #include "starruby_private.h"
 
 #define MAX_CHANNEL_COUNT (8)
+#define CHANNEL_COUNT_LIMIT (256)
+#define COALESCING_TICKS (50)
+#define RENDER_TIMEOUT (1000)
+#define DEFAULT_BUFFER_SIZE (1024)
+#define DEFAULT_STREAM_BUFFER_SIZE (8192)
+
+#ifdef __GNUC__
+#define MEMORY_BARRIER() __sync_synchronize()
+#else
+#define MEMORY_BARRIER() MemoryBarrier()
+#endif
+
+typedef enum {
+  AUDIO_DRIVER_DEFAULT,
+  AUDIO_DRIVER_NULL,
+  AUDIO_DRIVER_OFFLINE,
+} AudioDriver;
+
+typedef enum {
+  SE_STATE_UNLOADED,
+  SE_STATE_QUEUED,
+  SE_STATE_LOADING,
+  SE_STATE_DECODED,
+  SE_STATE_LOADED,
+  SE_STATE_FAILED,
+} SoundEffectState;
+
+/*
+ * A handle of a sound effect file, which is kept in rbChunkCache for each
+ * path. The decoded chunk may be evicted and loaded again later.
+ *
+ * The loader thread only moves a handle to SE_STATE_DECODED; it becomes
+ * SE_STATE_LOADED and joins the LRU list in CollectLoadedChunks.
+ */
+typedef struct SoundEffect {
+  VALUE rbPath;
+  char* path;
+  char* error;
+  Mix_Chunk* sdlChunk;
+  volatile SoundEffectState state;
+  struct SoundEffect* nextLoading;
+  bool isLinked;
+  struct SoundEffect* prev;
+  struct SoundEffect* next;
+} SoundEffect;
+
+/*
+ * A single-producer single-consumer ring buffer of 16-bit stereo frames:
+ * Ruby writes and advances writeIndex, and the mixer callback reads and
+ * advances readIndex. Only the list of playing streams takes the audio
+ * lock.
+ */
+typedef struct AudioStream {
+  int16_t* samples;
+  uint32_t capacity;
+  volatile uint32_t readIndex;
+  volatile uint32_t writeIndex;
+  volatile int volume;
+  volatile unsigned long underruns;
+  volatile unsigned long underrunFrames;
+  bool isPlaying;
+  struct AudioStream* next;
+} AudioStream;
+
+/*
+ * What is playing on each SDL_mixer channel
+ */
+typedef struct {
+  const Mix_Chunk* sdlChunk;
+  int priority;
+  int volume;
+  unsigned long frame;
+  Uint32 startTicks;
+  unsigned long serial;
+} Voice;
 
 static bool isEnabled = false;
+static int frequency = MIX_DEFAULT_FREQUENCY;
+static int bufferSize = DEFAULT_BUFFER_SIZE;
+static AudioDriver audioDriver = AUDIO_DRIVER_DEFAULT;
+static char* defaultSdlAudioDriver = NULL;
+static int channelCount = MAX_CHANNEL_COUNT;
+static Voice* voices = NULL;
+static unsigned long voiceSerial = 0;
+static unsigned long audioFrame = 0;
+static unsigned long coalescedCount = 0;
+static unsigned long droppedCount = 0;
+static unsigned long stolenCount = 0;
 static bool bgmLoop = false;
 static uint8_t bgmVolume = 255;
 static Mix_Music* sdlBgm = NULL;
@@ -11,19 +97,415 @@ static Uint32 sdlBgmLastPausedPosition = 0;
 
 static volatile VALUE rbChunkCache = Qundef;
 static volatile VALUE rbMusicCache = Qundef;
+static volatile VALUE rb_cSoundEffect = Qundef;
+
+static AudioStream* playingStreams = NULL;
+static bool isStreamable = false;
+
+/*
+ * The offline driver keeps the device paused except while Audio.render
+ * runs, and the post-mix callback copies the output to renderBuffer.
+ * mixedFrames is the audio clock used instead of SDL_GetTicks then.
+ */
+static volatile unsigned long mixedFrames = 0;
+static volatile bool isRendering = false;
+static uint8_t* renderBuffer = NULL;
+static size_t renderBufferSize = 0;
+static size_t renderLength = 0;
+static size_t renderTarget = 0;
+static SDL_sem* renderSem = NULL;
+
+static size_t chunkCacheLimit = 16 * 1024 * 1024;
+static size_t chunkBytes = 0;
+static int chunkCount = 0;
+static unsigned long chunkHits = 0;
+static unsigned long chunkMisses = 0;
+static unsigned long chunkEvictions = 0;
+static SoundEffect* newestSoundEffect = NULL;
+static SoundEffect* oldestSoundEffect = NULL;
+
+/*
+ * Chunks are decoded by one loader thread. The queue, the list of loaded
+ * sound effects and their states are guarded by loaderMutex.
+ */
+static SDL_Thread* loaderThread = NULL;
+static SDL_mutex* loaderMutex = NULL;
+static SDL_cond* loaderCond = NULL;
+static SoundEffect* queuedSoundEffects = NULL;
+static SoundEffect* loadedSoundEffects = NULL;
+static bool isLoaderQuitting = false;
+
+static volatile VALUE symbol_buffer_size = Qundef;
+static volatile VALUE symbol_bytes       = Qundef;
+static volatile VALUE symbol_channels    = Qundef;
+static volatile VALUE symbol_chunks      = Qundef;
+static volatile VALUE symbol_coalesced   = Qundef;
+static volatile VALUE symbol_default     = Qundef;
+static volatile VALUE symbol_driver      = Qundef;
+static volatile VALUE symbol_dropped     = Qundef;
+static volatile VALUE symbol_evictions   = Qundef;
+static volatile VALUE symbol_frequency   = Qundef;
+static volatile VALUE symbol_hits        = Qundef;
+static volatile VALUE symbol_loop        = Qundef;
+static volatile VALUE symbol_misses      = Qundef;
+static volatile VALUE symbol_null        = Qundef;
+static volatile VALUE symbol_offline     = Qundef;
+static volatile VALUE symbol_panning     = Qundef;
+static volatile VALUE symbol_path        = Qundef;
+static volatile VALUE symbol_position    = Qundef;
+static volatile VALUE symbol_priority    = Qundef;
+static volatile VALUE symbol_stolen      = Qundef;
+static volatile VALUE symbol_time        = Qundef;
+static volatile VALUE symbol_volume      = Qundef;
+
+static Uint32
+GetAudioTicks(void)
+{
+  if (audioDriver == AUDIO_DRIVER_OFFLINE) {
+    return (Uint32)((double)mixedFrames * 1000 / frequency);
+  }
+  return SDL_GetTicks();
+}
+
+static size_t
+GetChunkBytes(const Mix_Chunk* sdlChunk)
+{
+  return sizeof(Mix_Chunk) + sdlChunk->alen;
+}
+
+static char*
+CopyString(const char* str)
+{
+  // Called from the loader thread, so the Ruby allocator is not used
+  const size_t size = strlen(str) + 1;
+  char* copy = malloc(size);
+  if (copy) {
+    memcpy(copy, str, size);
+  }
+  return copy;
+}
+
+static bool
+IsChunkPlaying(const Mix_Chunk* sdlChunk)
+{
+  for (int i = 0; i < channelCount; i++) {
+    if (Mix_Playing(i) && Mix_GetChunk(i) == sdlChunk) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void
+UnlinkSoundEffect(SoundEffect* se)
+{
+  if (!se->isLinked) {
+    return;
+  }
+  if (se->prev) {
+    se->prev->next = se->next;
+  } else {
+    newestSoundEffect = se->next;
+  }
+  if (se->next) {
+    se->next->prev = se->prev;
+  } else {
+    oldestSoundEffect = se->prev;
+  }
+  se->prev = se->next = NULL;
+  se->isLinked = false;
+}
+
+static void
+LinkNewestSoundEffect(SoundEffect* se)
+{
+  se->prev = NULL;
+  se->next = newestSoundEffect;
+  if (newestSoundEffect) {
+    newestSoundEffect->prev = se;
+  } else {
+    oldestSoundEffect = se;
+  }
+  newestSoundEffect = se;
+  se->isLinked = true;
+}
+
+static void
+FreeSoundEffectChunk(SoundEffect* se)
+{
+  if (se->state == SE_STATE_LOADED) {
+    UnlinkSoundEffect(se);
+    chunkBytes -= GetChunkBytes(se->sdlChunk);
+    chunkCount--;
+    Mix_FreeChunk(se->sdlChunk);
+  }
+  se->sdlChunk = NULL;
+  se->state = SE_STATE_UNLOADED;
+}
+
+/*
+ * Evicts the least recently played chunks that are not playing now
+ */
+static void
+TrimChunkCache(size_t limit, const SoundEffect* keptSoundEffect)
+{
+  SoundEffect* se = oldestSoundEffect;
+  while (limit < chunkBytes && se) {
+    SoundEffect* newer = se->prev;
+    if (se != keptSoundEffect && !IsChunkPlaying(se->sdlChunk)) {
+      FreeSoundEffectChunk(se);
+      chunkEvictions++;
+    }
+    se = newer;
+  }
+}
+
+static void
+AddLoadedChunk(SoundEffect* se)
+{
+  LinkNewestSoundEffect(se);
+  chunkBytes += GetChunkBytes(se->sdlChunk);
+  chunkCount++;
+}
+
+/*
+ * Accounts chunks the loader thread has finished
+ */
+static void
+CollectLoadedChunks(void)
+{
+  if (!loaderMutex) {
+    return;
+  }
+  SDL_LockMutex(loaderMutex);
+  SoundEffect* se = loadedSoundEffects;
+  loadedSoundEffects = NULL;
+  while (se) {
+    SoundEffect* next = se->nextLoading;
+    se->nextLoading = NULL;
+    if (se->state == SE_STATE_DECODED) {
+      se->state = SE_STATE_LOADED;
+      AddLoadedChunk(se);
+    }
+    se = next;
+  }
+  SDL_UnlockMutex(loaderMutex);
+  TrimChunkCache(chunkCacheLimit, NULL);
+}
+
+static int
+LoadChunks(void* unused)
+{
+  SDL_LockMutex(loaderMutex);
+  for (;;) {
+    while (!queuedSoundEffects && !isLoaderQuitting) {
+      SDL_CondWait(loaderCond, loaderMutex);
+    }
+    if (isLoaderQuitting) {
+      break;
+    }
+    SoundEffect* se = queuedSoundEffects;
+    queuedSoundEffects = se->nextLoading;
+    se->state = SE_STATE_LOADING;
+    SDL_UnlockMutex(loaderMutex);
+    Mix_Chunk* sdlChunk = Mix_LoadWAV(se->path);
+    char* error = sdlChunk ? NULL : CopyString(Mix_GetError());
+    SDL_LockMutex(loaderMutex);
+    se->sdlChunk = sdlChunk;
+    se->error = error;
+    se->state = sdlChunk ? SE_STATE_DECODED : SE_STATE_FAILED;
+    se->nextLoading = loadedSoundEffects;
+    loadedSoundEffects = se;
+    SDL_CondBroadcast(loaderCond);
+  }
+  SDL_UnlockMutex(loaderMutex);
+  return 0;
+}
+
+static void
+QueueSoundEffect(SoundEffect* se)
+{
+  if (!loaderMutex) {
+    loaderMutex = SDL_CreateMutex();
+    loaderCond  = SDL_CreateCond();
+    isLoaderQuitting = false;
+    loaderThread = SDL_CreateThread(LoadChunks, NULL);
+    if (!loaderThread) {
+      // Chunks are loaded on demand instead
+      SDL_DestroyCond(loaderCond);
+      SDL_DestroyMutex(loaderMutex);
+      loaderCond  = NULL;
+      loaderMutex = NULL;
+      return;
+    }
+  }
+  SDL_LockMutex(loaderMutex);
+  se->state = SE_STATE_QUEUED;
+  se->nextLoading = NULL;
+  SoundEffect** tail = &queuedSoundEffects;
+  while (*tail) {
+    tail = &((*tail)->nextLoading);
+  }
+  *tail = se;
+  SDL_CondSignal(loaderCond);
+  SDL_UnlockMutex(loaderMutex);
+}
 
-static volatile VALUE symbol_loop     = Qundef;
-static volatile VALUE symbol_panning  = Qundef;
-static volatile VALUE symbol_position = Qundef;
-static volatile VALUE symbol_time     = Qundef;
-static volatile VALUE symbol_volume   = Qundef;
+static void
+StopChunkLoader(void)
+{
+  if (!loaderMutex) {
+    return;
+  }
+  SDL_LockMutex(loaderMutex);
+  isLoaderQuitting = true;
+  SDL_CondBroadcast(loaderCond);
+  SDL_UnlockMutex(loaderMutex);
+  SDL_WaitThread(loaderThread, NULL);
+  loaderThread = NULL;
+  while (queuedSoundEffects) {
+    SoundEffect* se = queuedSoundEffects;
+    queuedSoundEffects = se->nextLoading;
+    se->nextLoading = NULL;
+    se->state = SE_STATE_UNLOADED;
+  }
+  CollectLoadedChunks();
+  SDL_DestroyCond(loaderCond);
+  SDL_DestroyMutex(loaderMutex);
+  loaderCond  = NULL;
+  loaderMutex = NULL;
+}
+
+/*
+ * Returns the decoded chunk, waiting for the loader thread or loading it
+ * here if needed
+ */
+static Mix_Chunk*
+GetSoundEffectChunk(SoundEffect* se)
+{
+  CollectLoadedChunks();
+  if (loaderMutex && se->state != SE_STATE_LOADED) {
+    SDL_LockMutex(loaderMutex);
+    if (se->state == SE_STATE_QUEUED) {
+      SoundEffect** s = &queuedSoundEffects;
+      while (*s != se) {
+        s = &((*s)->nextLoading);
+      }
+      *s = se->nextLoading;
+      se->nextLoading = NULL;
+      se->state = SE_STATE_UNLOADED;
+    }
+    while (se->state == SE_STATE_LOADING) {
+      SDL_CondWait(loaderCond, loaderMutex);
+    }
+    SDL_UnlockMutex(loaderMutex);
+    CollectLoadedChunks();
+  }
+  switch (se->state) {
+  case SE_STATE_LOADED:
+    if (newestSoundEffect != se) {
+      UnlinkSoundEffect(se);
+      LinkNewestSoundEffect(se);
+    }
+    chunkHits++;
+    break;
+  case SE_STATE_FAILED:
+    {
+      // The next play tries loading again
+      volatile VALUE rbError = rb_str_new2(se->error ? se->error : se->path);
+      free(se->error);
+      se->error = NULL;
+      se->state = SE_STATE_UNLOADED;
+      rb_raise(strb_GetStarRubyErrorClass(), "%s", StringValueCStr(rbError));
+    }
+    break;
+  default:
+    chunkMisses++;
+    if (!(se->sdlChunk = Mix_LoadWAV(se->path))) {
+      rb_raise_sdl_mix_error();
+    }
+    se->state = SE_STATE_LOADED;
+    AddLoadedChunk(se);
+    TrimChunkCache(chunkCacheLimit, se);
+    break;
+  }
+  return se->sdlChunk;
+}
+
+static void
+SoundEffect_mark(SoundEffect* se)
+{
+  rb_gc_mark(se->rbPath);
+}
+
+static void
+SoundEffect_free(SoundEffect* se)
+{
+  FreeSoundEffectChunk(se);
+  free(se->error);
+  free(se->path);
+  free(se);
+}
+
+/*
+ * Returns the handle for the path, creating it and queueing its decoding
+ * on the first call
+ */
+static VALUE
+SoundEffect_s_load(VALUE self, VALUE rbPath)
+{
+  volatile VALUE rbCompletePath = strb_GetCompletePath(rbPath, true);
+  volatile VALUE rbSoundEffect = rb_hash_aref(rbChunkCache, rbCompletePath);
+  if (!NIL_P(rbSoundEffect)) {
+    return rbSoundEffect;
+  }
+  SoundEffect* se = ALLOC(SoundEffect);
+  MEMZERO(se, SoundEffect, 1);
+  se->rbPath = rb_str_new_frozen(rbCompletePath);
+  se->path = CopyString(StringValueCStr(rbCompletePath));
+  se->state = SE_STATE_UNLOADED;
+  rbSoundEffect = Data_Wrap_Struct(rb_cSoundEffect,
+                                   SoundEffect_mark, SoundEffect_free, se);
+  rb_hash_aset(rbChunkCache, se->rbPath, rbSoundEffect);
+  if (isEnabled) {
+    QueueSoundEffect(se);
+  }
+  return rbSoundEffect;
+}
+
+static VALUE
+SoundEffect_bytes(VALUE self)
+{
+  const SoundEffect* se;
+  Data_Get_Struct(self, SoundEffect, se);
+  CollectLoadedChunks();
+  return ULONG2NUM(se->state == SE_STATE_LOADED ?
+                   GetChunkBytes(se->sdlChunk) : 0);
+}
+
+static VALUE
+SoundEffect_loaded(VALUE self)
+{
+  const SoundEffect* se;
+  Data_Get_Struct(self, SoundEffect, se);
+  CollectLoadedChunks();
+  return se->state == SE_STATE_LOADED ? Qtrue : Qfalse;
+}
+
+static VALUE
+SoundEffect_path(VALUE self)
+{
+  const SoundEffect* se;
+  Data_Get_Struct(self, SoundEffect, se);
+  return se->rbPath;
+}
 
 static VALUE
 Audio_bgm_position(VALUE self)
 {
   if (isEnabled) {
     if (Mix_PlayingMusic()) {
-      sdlBgmLastPausedPosition = SDL_GetTicks() - sdlBgmStartTicks;
+      sdlBgmLastPausedPosition = GetAudioTicks() - sdlBgmStartTicks;
     }
     return LONG2NUM(sdlBgmLastPausedPosition);
   } else {
@@ -102,66 +584,116 @@ Audio_play_bgm(int argc, VALUE* argv, VALUE self)
   if (Mix_FadeInMusicPos(sdlBgm, 0, time, bgmPosition)) {
     rb_raise_sdl_mix_error();
   }
-  sdlBgmStartTicks = SDL_GetTicks() - bgmPosition;
+  sdlBgmStartTicks = GetAudioTicks() - bgmPosition;
   
   return Qnil;
 }
 
-static VALUE
-Audio_play_se(int argc, VALUE* argv, VALUE self)
+static int
+GetCoalescingChannel(const Mix_Chunk* sdlChunk, Uint32 now)
 {
-  volatile VALUE rbPath, rbOptions;
-  rb_scan_args(argc, argv, "11", &rbPath, &rbOptions);
-  if (NIL_P(rbOptions)) {
-    rbOptions = rb_hash_new();
-  }
-  Check_Type(rbOptions, T_HASH);
-
-  volatile VALUE rbCompletePath = strb_GetCompletePath(rbPath, true);
-  Mix_Chunk* sdlSE = NULL;
-  volatile VALUE val;
-  if (isEnabled) {
-    if (!NIL_P(val = rb_hash_aref(rbChunkCache, rbCompletePath))) {
-      sdlSE = (Mix_Chunk*)NUM2ULONG(val);
-    } else {
-      const char* path = StringValueCStr(rbCompletePath);
-      if (!(sdlSE = Mix_LoadWAV(path))) {
-        rb_raise_sdl_mix_error();
-      }
-      rb_hash_aset(rbChunkCache, rbCompletePath, ULONG2NUM((unsigned long)sdlSE));
+  for (int i = 0; i < channelCount; i++) {
+    const Voice* voice = &(voices[i]);
+    if (voice->sdlChunk == sdlChunk && voice->frame == audioFrame &&
+        now - voice->startTicks < COALESCING_TICKS && Mix_Playing(i)) {
+      return i;
     }
   }
+  return -1;
+}
 
-  int panning = 0;
-  int time    = 0;
-  int volume  = 255;
-  if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_panning))) {
-    panning = NUM2INT(val);
-    if (panning <= -256 || 256 <= panning) {
-      rb_raise(rb_eArgError, "invalid panning: %d", panning);
+/*
+ * Returns a channel not playing, or else halts the voice with the lowest
+ * priority (the oldest one among them) unless it is more important
+ */
+static int
+GetFreeChannel(int priority)
+{
+  int victim = -1;
+  for (int i = 0; i < channelCount; i++) {
+    if (!Mix_Playing(i)) {
+      return i;
+    }
+    if (victim == -1 ||
+        voices[i].priority < voices[victim].priority ||
+        (voices[i].priority == voices[victim].priority &&
+         voices[i].serial < voices[victim].serial)) {
+      victim = i;
     }
   }
-  if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_time))) {
-    time = NUM2INT(val);
+  if (victim == -1 || priority < voices[victim].priority) {
+    return -1;
   }
-  if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_volume))) {
-    volume = NUM2INT(val);
-    if (volume < 0 || 256 <= volume) {
-      rb_raise(rb_eArgError, "invalid volume: %d", volume);
+  Mix_HaltChannel(victim);
+  stolenCount++;
+  return victim;
+}
+
+static VALUE
+PlaySoundEffect(SoundEffect* se, VALUE rbOptions)
+{
+  int panning  = 0;
+  int priority = 0;
+  int time     = 0;
+  int volume   = 255;
+  if (!NIL_P(rbOptions)) {
+    Check_Type(rbOptions, T_HASH);
+    volatile VALUE val;
+    if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_panning))) {
+      panning = NUM2INT(val);
+      if (panning <= -256 || 256 <= panning) {
+        rb_raise(rb_eArgError, "invalid panning: %d", panning);
+      }
+    }
+    if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_priority))) {
+      priority = NUM2INT(val);
+    }
+    if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_time))) {
+      time = NUM2INT(val);
+    }
+    if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_volume))) {
+      volume = NUM2INT(val);
+      if (volume < 0 || 256 <= volume) {
+        rb_raise(rb_eArgError, "invalid volume: %d", volume);
+      }
     }
   }
   if (!isEnabled) {
     return Qnil;
   }
-  int sdlChannel;
+  Mix_Chunk* sdlSE = GetSoundEffectChunk(se);
+  const Uint32 now = GetAudioTicks();
+  int sdlChannel = GetCoalescingChannel(sdlSE, now);
+  if (sdlChannel != -1) {
+    // Merged into the same sound started in this frame
+    Voice* voice = &(voices[sdlChannel]);
+    voice->volume   = MIN(voice->volume + volume, 255);
+    voice->priority = MAX(voice->priority, priority);
+    Mix_Volume(sdlChannel, DIV255(voice->volume * MIX_MAX_VOLUME));
+    coalescedCount++;
+    return Qnil;
+  }
+  if ((sdlChannel = GetFreeChannel(priority)) == -1) {
+    droppedCount++;
+    return Qnil;
+  }
   if (time < 250) {
-    sdlChannel = Mix_PlayChannel(-1, sdlSE, 0);
+    sdlChannel = Mix_PlayChannel(sdlChannel, sdlSE, 0);
   } else {
-    sdlChannel = Mix_FadeInChannel(-1, sdlSE, 0, time);
+    sdlChannel = Mix_FadeInChannel(sdlChannel, sdlSE, 0, time);
   }
   if (sdlChannel == -1) {
+    droppedCount++;
     return Qnil;
   }
+  voices[sdlChannel] = (Voice){
+    .sdlChunk   = sdlSE,
+    .priority   = priority,
+    .volume     = volume,
+    .frame      = audioFrame,
+    .startTicks = now,
+    .serial     = voiceSerial++,
+  };
   Mix_Volume(sdlChannel, DIV255(volume * MIX_MAX_VOLUME));
   int sdlLeftPanning  = 255;
   int sdlRightPanning = 255;
@@ -173,10 +705,132 @@ Audio_play_se(int argc, VALUE* argv, VALUE self)
   if (!Mix_SetPanning(sdlChannel, sdlLeftPanning, sdlRightPanning)) {
     rb_raise_sdl_mix_error();
   }
-
   return Qnil;
 }
 
+static VALUE
+Audio_play_se(int argc, VALUE* argv, VALUE self)
+{
+  volatile VALUE rbPath, rbOptions;
+  rb_scan_args(argc, argv, "11", &rbPath, &rbOptions);
+  if (NIL_P(rbOptions)) {
+    rbOptions = rb_hash_new();
+  }
+  Check_Type(rbOptions, T_HASH);
+  volatile VALUE rbSoundEffect = SoundEffect_s_load(rb_cSoundEffect, rbPath);
+  SoundEffect* se;
+  Data_Get_Struct(rbSoundEffect, SoundEffect, se);
+  return PlaySoundEffect(se, rbOptions);
+}
+
+static VALUE
+SoundEffect_play(int argc, VALUE* argv, VALUE self)
+{
+  volatile VALUE rbOptions;
+  rb_scan_args(argc, argv, "01", &rbOptions);
+  SoundEffect* se;
+  Data_Get_Struct(self, SoundEffect, se);
+  return PlaySoundEffect(se, rbOptions);
+}
+
+static VALUE
+Audio_preload(int argc, VALUE* argv, VALUE self)
+{
+  volatile VALUE rbPaths = rb_ary_new4(argc, argv);
+  rbPaths = rb_funcall(rbPaths, rb_intern("flatten"), 0);
+  volatile VALUE rbSoundEffects = rb_ary_new();
+  for (int i = 0; i < RARRAY_LEN(rbPaths); i++) {
+    rb_ary_push(rbSoundEffects,
+                SoundEffect_s_load(rb_cSoundEffect, rb_ary_entry(rbPaths, i)));
+  }
+  OBJ_FREEZE(rbSoundEffects);
+  return rbSoundEffects;
+}
+
+static void
+SetChannelCount(int count)
+{
+  Voice* newVoices = ALLOC_N(Voice, count);
+  MEMZERO(newVoices, Voice, count);
+  if (voices) {
+    MEMCPY(newVoices, voices, Voice, MIN(channelCount, count));
+    xfree(voices);
+  }
+  voices = newVoices;
+  channelCount = count;
+  if (isEnabled) {
+    Mix_AllocateChannels(channelCount);
+  }
+}
+
+static VALUE
+Audio_se_channel_count(VALUE self)
+{
+  return INT2NUM(channelCount);
+}
+
+static VALUE
+Audio_se_channel_count_eq(VALUE self, VALUE rbCount)
+{
+  const int count = NUM2INT(rbCount);
+  if (count < 1 || CHANNEL_COUNT_LIMIT < count) {
+    rb_raise(rb_eArgError, "invalid channel count: %d", count);
+  }
+  SetChannelCount(count);
+  return rbCount;
+}
+
+static VALUE
+Audio_voice_stats(VALUE self)
+{
+  volatile VALUE rbStats = rb_hash_new();
+  rb_hash_aset(rbStats, symbol_channels,  INT2NUM(channelCount));
+  rb_hash_aset(rbStats, symbol_coalesced, ULONG2NUM(coalescedCount));
+  rb_hash_aset(rbStats, symbol_dropped,   ULONG2NUM(droppedCount));
+  rb_hash_aset(rbStats, symbol_stolen,    ULONG2NUM(stolenCount));
+  OBJ_FREEZE(rbStats);
+  return rbStats;
+}
+
+void
+strb_UpdateAudio(void)
+{
+  audioFrame++;
+}
+
+static VALUE
+Audio_chunk_cache_limit(VALUE self)
+{
+  return ULONG2NUM(chunkCacheLimit);
+}
+
+static VALUE
+Audio_chunk_cache_limit_eq(VALUE self, VALUE rbLimit)
+{
+  const long limit = NUM2LONG(rbLimit);
+  if (limit < 0) {
+    rb_raise(rb_eArgError, "invalid chunk cache limit: %ld", limit);
+  }
+  chunkCacheLimit = limit;
+  CollectLoadedChunks();
+  TrimChunkCache(chunkCacheLimit, NULL);
+  return rbLimit;
+}
+
+static VALUE
+Audio_chunk_cache_stats(VALUE self)
+{
+  CollectLoadedChunks();
+  volatile VALUE rbStats = rb_hash_new();
+  rb_hash_aset(rbStats, symbol_bytes,     ULONG2NUM(chunkBytes));
+  rb_hash_aset(rbStats, symbol_chunks,    INT2NUM(chunkCount));
+  rb_hash_aset(rbStats, symbol_hits,      ULONG2NUM(chunkHits));
+  rb_hash_aset(rbStats, symbol_misses,    ULONG2NUM(chunkMisses));
+  rb_hash_aset(rbStats, symbol_evictions, ULONG2NUM(chunkEvictions));
+  OBJ_FREEZE(rbStats);
+  return rbStats;
+}
+
 static VALUE
 Audio_playing_bgm(VALUE self)
 {
@@ -252,24 +906,540 @@ static void
 SdlMusicFinished(void)
 {
   if (sdlBgm && bgmLoop) {
-    sdlBgmStartTicks = SDL_GetTicks();
+    sdlBgmStartTicks = GetAudioTicks();
     if (isEnabled && Mix_PlayMusic(sdlBgm, 0)) {
       rb_raise_sdl_mix_error();
     }
   }
 }
 
+static void
+MixStreams(void* unused, Uint8* buffer, int length)
+{
+  int16_t* out = (int16_t*)buffer;
+  const uint32_t frameCount = length / (2 * sizeof(int16_t));
+  for (AudioStream* stream = playingStreams; stream; stream = stream->next) {
+    const uint32_t readIndex = stream->readIndex;
+    const uint32_t writeIndex = stream->writeIndex;
+    MEMORY_BARRIER();
+    const uint32_t queued = writeIndex - readIndex;
+    const uint32_t n = MIN(queued, frameCount);
+    if (n < frameCount) {
+      stream->underruns++;
+      stream->underrunFrames += frameCount - n;
+    }
+    const int volume = stream->volume;
+    const uint32_t mask = stream->capacity - 1;
+    for (uint32_t i = 0; i < n; i++) {
+      const int16_t* frame = &(stream->samples[((readIndex + i) & mask) * 2]);
+      for (int c = 0; c < 2; c++) {
+        const int sample = out[i * 2 + c] + DIV255(frame[c] * volume);
+        out[i * 2 + c] = MAX(-32768, MIN(sample, 32767));
+      }
+    }
+    MEMORY_BARRIER();
+    stream->readIndex = readIndex + n;
+  }
+}
+
+static void
+PostMix(void* unused, Uint8* buffer, int length)
+{
+  if (isStreamable) {
+    MixStreams(unused, buffer, length);
+  }
+  mixedFrames += length / (2 * sizeof(int16_t));
+  if (isRendering) {
+    const size_t size = MIN((size_t)length, renderBufferSize - renderLength);
+    memcpy(renderBuffer + renderLength, buffer, size);
+    renderLength += size;
+    if (renderTarget <= renderLength) {
+      isRendering = false;
+      SDL_PauseAudio(1);
+      SDL_SemPost(renderSem);
+    }
+  }
+}
+
+static void
+AudioStream_free(AudioStream* stream)
+{
+  if (stream->isPlaying) {
+    SDL_LockAudio();
+    AudioStream** s = &playingStreams;
+    while (*s != stream) {
+      s = &((*s)->next);
+    }
+    *s = stream->next;
+    SDL_UnlockAudio();
+  }
+  free(stream->samples);
+  free(stream);
+}
+
+static VALUE
+AudioStream_alloc(VALUE klass)
+{
+  AudioStream* stream = ALLOC(AudioStream);
+  MEMZERO(stream, AudioStream, 1);
+  return Data_Wrap_Struct(klass, 0, AudioStream_free, stream);
+}
+
+static VALUE
+AudioStream_initialize(int argc, VALUE* argv, VALUE self)
+{
+  volatile VALUE rbOptions;
+  rb_scan_args(argc, argv, "01", &rbOptions);
+  if (NIL_P(rbOptions)) {
+    rbOptions = rb_hash_new();
+  }
+  Check_Type(rbOptions, T_HASH);
+  long size = DEFAULT_STREAM_BUFFER_SIZE;
+  volatile VALUE val;
+  if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_buffer_size))) {
+    size = NUM2LONG(val);
+    if (size <= 0 || (1 << 24) < size) {
+      rb_raise(rb_eArgError, "invalid buffer size: %ld", size);
+    }
+  }
+  uint32_t capacity = 1;
+  while (capacity < size) {
+    capacity <<= 1;
+  }
+  AudioStream* stream;
+  Data_Get_Struct(self, AudioStream, stream);
+  // The mixer thread reads the samples, so the Ruby allocator is not used
+  if (!(stream->samples = malloc(capacity * 2 * sizeof(int16_t)))) {
+    rb_raise(rb_eNoMemError, "failed to allocate a stream buffer");
+  }
+  stream->capacity = capacity;
+  stream->volume = 255;
+  return Qnil;
+}
+
+static VALUE
+AudioStream_buffer_size(VALUE self)
+{
+  const AudioStream* stream;
+  Data_Get_Struct(self, AudioStream, stream);
+  return ULONG2NUM(stream->capacity);
+}
+
+static VALUE
+AudioStream_play(VALUE self)
+{
+  AudioStream* stream;
+  Data_Get_Struct(self, AudioStream, stream);
+  if (!stream->isPlaying) {
+    SDL_LockAudio();
+    stream->next = playingStreams;
+    playingStreams = stream;
+    stream->isPlaying = true;
+    SDL_UnlockAudio();
+  }
+  return self;
+}
+
+static VALUE
+AudioStream_playing(VALUE self)
+{
+  const AudioStream* stream;
+  Data_Get_Struct(self, AudioStream, stream);
+  return stream->isPlaying ? Qtrue : Qfalse;
+}
+
+static VALUE
+AudioStream_queued_frames(VALUE self)
+{
+  const AudioStream* stream;
+  Data_Get_Struct(self, AudioStream, stream);
+  return ULONG2NUM(stream->writeIndex - stream->readIndex);
+}
+
+static VALUE
+AudioStream_stop(VALUE self)
+{
+  AudioStream* stream;
+  Data_Get_Struct(self, AudioStream, stream);
+  if (stream->isPlaying) {
+    SDL_LockAudio();
+    AudioStream** s = &playingStreams;
+    while (*s != stream) {
+      s = &((*s)->next);
+    }
+    *s = stream->next;
+    stream->next = NULL;
+    stream->isPlaying = false;
+    SDL_UnlockAudio();
+  }
+  return self;
+}
+
+static VALUE
+AudioStream_underrun_frames(VALUE self)
+{
+  const AudioStream* stream;
+  Data_Get_Struct(self, AudioStream, stream);
+  return ULONG2NUM(stream->underrunFrames);
+}
+
+static VALUE
+AudioStream_underruns(VALUE self)
+{
+  const AudioStream* stream;
+  Data_Get_Struct(self, AudioStream, stream);
+  return ULONG2NUM(stream->underruns);
+}
+
+static VALUE
+AudioStream_volume(VALUE self)
+{
+  const AudioStream* stream;
+  Data_Get_Struct(self, AudioStream, stream);
+  return INT2FIX(stream->volume);
+}
+
+static VALUE
+AudioStream_volume_eq(VALUE self, VALUE rbVolume)
+{
+  AudioStream* stream;
+  Data_Get_Struct(self, AudioStream, stream);
+  const int volume = NUM2INT(rbVolume);
+  if (volume < 0 || 256 <= volume) {
+    rb_raise(rb_eArgError, "invalid volume: %d", volume);
+  }
+  stream->volume = volume;
+  return rbVolume;
+}
+
+/*
+ * Queues packed 16-bit native-endian stereo samples and returns the
+ * number of frames taken, which is less than given if the buffer is full
+ */
+static VALUE
+AudioStream_write(VALUE self, VALUE rbData)
+{
+  AudioStream* stream;
+  Data_Get_Struct(self, AudioStream, stream);
+  StringValue(rbData);
+  const long frameSize = 2 * sizeof(int16_t);
+  if (RSTRING_LEN(rbData) % frameSize) {
+    rb_raise(rb_eArgError, "invalid data length: %ld", RSTRING_LEN(rbData));
+  }
+  const uint32_t readIndex = stream->readIndex;
+  const uint32_t writeIndex = stream->writeIndex;
+  MEMORY_BARRIER();
+  const uint32_t space = stream->capacity - (writeIndex - readIndex);
+  const uint32_t n = MIN(space, (uint32_t)(RSTRING_LEN(rbData) / frameSize));
+  const uint32_t mask = stream->capacity - 1;
+  const int16_t* src = (const int16_t*)RSTRING_PTR(rbData);
+  for (uint32_t i = 0; i < n; i++) {
+    int16_t* frame = &(stream->samples[((writeIndex + i) & mask) * 2]);
+    frame[0] = src[i * 2];
+    frame[1] = src[i * 2 + 1];
+  }
+  MEMORY_BARRIER();
+  stream->writeIndex = writeIndex + n;
+  return ULONG2NUM(n);
+}
+
+static int
+FreeChunkCacheItem(VALUE rbKey, VALUE rbValue)
+{
+  SoundEffect* se;
+  Data_Get_Struct(rbValue, SoundEffect, se);
+  FreeSoundEffectChunk(se);
+  return ST_CONTINUE;
+}
+
+static int
+FreeMusicCacheItem(VALUE rbKey, VALUE rbValue)
+{
+  Mix_Music* music = (Mix_Music*)NUM2ULONG(rbValue);
+  if (music) {
+    Mix_FreeMusic(music);
+  }
+  return ST_CONTINUE;
+}
+
+/*
+ * Frees everything decoded for the current device format. Sound effect
+ * handles are kept and load their chunks again on the next play.
+ */
+static void
+CloseAudio(void)
+{
+  StopChunkLoader();
+  rb_hash_foreach(rbChunkCache, FreeChunkCacheItem, 0);
+  if (isEnabled) {
+    Mix_HaltMusic();
+  }
+  sdlBgm = NULL;
+  rb_hash_foreach(rbMusicCache, FreeMusicCacheItem, 0);
+  rb_hash_clear(rbMusicCache);
+  if (isEnabled) {
+    Mix_CloseAudio();
+  }
+  isEnabled = false;
+  isStreamable = false;
+}
+
+static void
+SetAudioDriver(AudioDriver driver)
+{
+  // The audio subsystem is initialized again by Mix_OpenAudio
+  SDL_QuitSubSystem(SDL_INIT_AUDIO);
+  audioDriver = driver;
+  switch (driver) {
+  case AUDIO_DRIVER_NULL:
+    ruby_setenv("SDL_AUDIODRIVER", "dummy");
+    break;
+  case AUDIO_DRIVER_OFFLINE:
+    ruby_setenv("SDL_AUDIODRIVER", "disk");
+#ifdef WIN32
+    ruby_setenv("SDL_DISKAUDIOFILE", "NUL");
+#else
+    ruby_setenv("SDL_DISKAUDIOFILE", "/dev/null");
+#endif
+    ruby_setenv("SDL_DISKAUDIODELAY", "1");
+    break;
+  default:
+    ruby_setenv("SDL_AUDIODRIVER", defaultSdlAudioDriver);
+    break;
+  }
+}
+
+static bool
+OpenAudio(void)
+{
+  if (Mix_OpenAudio(frequency, MIX_DEFAULT_FORMAT, 2, bufferSize)) {
+    isEnabled = false;
+    return false;
+  }
+  int obtainedFrequency, obtainedChannels;
+  Uint16 obtainedFormat;
+  Mix_QuerySpec(&obtainedFrequency, &obtainedFormat, &obtainedChannels);
+  frequency = obtainedFrequency;
+  Mix_HookMusicFinished(SdlMusicFinished);
+  // Streams are mixed only in the format they are written in
+  isStreamable = (obtainedFormat == AUDIO_S16SYS && obtainedChannels == 2);
+  Mix_SetPostMix(PostMix, NULL);
+  if (audioDriver == AUDIO_DRIVER_OFFLINE) {
+    SDL_PauseAudio(1);
+    SDL_LockAudio();
+    mixedFrames = 0;
+    SDL_UnlockAudio();
+  }
+  isEnabled = true;
+  SetChannelCount(channelCount);
+  Audio_bgm_volume_eq(Qnil, INT2FIX(bgmVolume));
+  return true;
+}
+
+static VALUE
+Audio_buffer_size(VALUE self)
+{
+  return INT2NUM(bufferSize);
+}
+
+static VALUE
+Audio_enabled(VALUE self)
+{
+  return isEnabled ? Qtrue : Qfalse;
+}
+
+static VALUE
+Audio_frequency(VALUE self)
+{
+  return INT2NUM(frequency);
+}
+
+/*
+ * Reopens the audio device. All sounds are stopped.
+ */
+static VALUE
+Audio_open(int argc, VALUE* argv, VALUE self)
+{
+  volatile VALUE rbOptions;
+  rb_scan_args(argc, argv, "01", &rbOptions);
+  if (NIL_P(rbOptions)) {
+    rbOptions = rb_hash_new();
+  }
+  Check_Type(rbOptions, T_HASH);
+  int newFrequency  = MIX_DEFAULT_FREQUENCY;
+  int newBufferSize = DEFAULT_BUFFER_SIZE;
+  AudioDriver newDriver = audioDriver;
+  volatile VALUE val;
+  if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_driver))) {
+    if (val == symbol_default) {
+      newDriver = AUDIO_DRIVER_DEFAULT;
+    } else if (val == symbol_null) {
+      newDriver = AUDIO_DRIVER_NULL;
+    } else if (val == symbol_offline) {
+      newDriver = AUDIO_DRIVER_OFFLINE;
+    } else {
+      volatile VALUE rbDriverStr = rb_inspect(val);
+      rb_raise(rb_eArgError, "invalid driver: %s",
+               StringValueCStr(rbDriverStr));
+    }
+  }
+  if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_frequency))) {
+    newFrequency = NUM2INT(val);
+    if (newFrequency <= 0) {
+      rb_raise(rb_eArgError, "invalid frequency: %d", newFrequency);
+    }
+  }
+  if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_buffer_size))) {
+    newBufferSize = NUM2INT(val);
+    if (newBufferSize <= 0 || 65536 < newBufferSize ||
+        (newBufferSize & (newBufferSize - 1))) {
+      rb_raise(rb_eArgError, "invalid buffer size: %d", newBufferSize);
+    }
+  }
+  CloseAudio();
+  SetAudioDriver(newDriver);
+  frequency  = newFrequency;
+  bufferSize = newBufferSize;
+  if (!OpenAudio()) {
+    rb_raise_sdl_mix_error();
+  }
+  return Qnil;
+}
+
+static VALUE
+Audio_driver(VALUE self)
+{
+  switch (audioDriver) {
+  case AUDIO_DRIVER_NULL:
+    return symbol_null;
+  case AUDIO_DRIVER_OFFLINE:
+    return symbol_offline;
+  default:
+    return symbol_default;
+  }
+}
+
+inline static void
+PutUint32(uint8_t* p, uint32_t value)
+{
+  for (int i = 0; i < 4; i++) {
+    p[i] = (value >> (i * 8)) & 0xff;
+  }
+}
+
+static void
+WriteWav(const char* path, const uint8_t* data, uint32_t length)
+{
+  FILE* fp = fopen(path, "wb");
+  if (!fp) {
+    rb_raise(rb_path2class("Errno::ENOENT"), "%s", path);
+  }
+  // 16-bit stereo linear PCM
+  uint8_t header[44];
+  memcpy(header, "RIFF", 4);
+  PutUint32(header + 4, 36 + length);
+  memcpy(header + 8, "WAVEfmt ", 8);
+  PutUint32(header + 16, 16);
+  PutUint32(header + 20, 1 | (2 << 16));
+  PutUint32(header + 24, frequency);
+  PutUint32(header + 28, frequency * 4);
+  PutUint32(header + 32, 4 | (16 << 16));
+  memcpy(header + 36, "data", 4);
+  PutUint32(header + 40, length);
+  fwrite(header, 1, sizeof(header), fp);
+  fwrite(data, 1, length, fp);
+  fclose(fp);
+}
+
+/*
+ * Runs the mixer for the duration (in milliseconds, rounded up to the
+ * buffer size) as fast as the offline driver goes, and returns the
+ * output as packed 16-bit stereo samples
+ */
+static VALUE
+Audio_render(int argc, VALUE* argv, VALUE self)
+{
+  volatile VALUE rbDuration, rbOptions;
+  rb_scan_args(argc, argv, "11", &rbDuration, &rbOptions);
+  if (NIL_P(rbOptions)) {
+    rbOptions = rb_hash_new();
+  }
+  Check_Type(rbOptions, T_HASH);
+  const int duration = NUM2INT(rbDuration);
+  if (duration < 0) {
+    rb_raise(rb_eArgError, "invalid duration: %d", duration);
+  }
+  volatile VALUE rbPath = rb_hash_aref(rbOptions, symbol_path);
+  if (!NIL_P(rbPath)) {
+    StringValueCStr(rbPath);
+  }
+  if (audioDriver != AUDIO_DRIVER_OFFLINE || !isEnabled) {
+    rb_raise(strb_GetStarRubyErrorClass(), "audio is not opened offline");
+  }
+  const size_t frameSize = 2 * sizeof(int16_t);
+  const size_t frameCount = (size_t)((double)duration * frequency / 1000);
+  const size_t bufferCount = (frameCount + bufferSize - 1) / bufferSize;
+  renderTarget = bufferCount * bufferSize * frameSize;
+  renderLength = 0;
+  if (renderTarget) {
+    renderBufferSize = renderTarget;
+    if (!(renderBuffer = malloc(renderBufferSize))) {
+      rb_raise(rb_eNoMemError, "failed to allocate a render buffer");
+    }
+    if (!renderSem) {
+      renderSem = SDL_CreateSemaphore(0);
+    }
+    SDL_LockAudio();
+    isRendering = true;
+    SDL_UnlockAudio();
+    SDL_PauseAudio(0);
+    size_t lastLength = 0;
+    while (SDL_SemWaitTimeout(renderSem, RENDER_TIMEOUT) ==
+           SDL_MUTEX_TIMEDOUT) {
+      if (renderLength != lastLength) {
+        lastLength = renderLength;
+        continue;
+      }
+      // The driver stopped calling back
+      SDL_LockAudio();
+      isRendering = false;
+      SDL_UnlockAudio();
+      SDL_PauseAudio(1);
+      SDL_SemTryWait(renderSem);
+      free(renderBuffer);
+      renderBuffer = NULL;
+      renderBufferSize = 0;
+      rb_raise(strb_GetStarRubyErrorClass(), "audio rendering timed out");
+    }
+  }
+  volatile VALUE rbData = rb_str_new((char*)renderBuffer, renderLength);
+  free(renderBuffer);
+  renderBuffer = NULL;
+  renderBufferSize = 0;
+  if (!NIL_P(rbPath)) {
+    WriteWav(StringValueCStr(rbPath), (uint8_t*)RSTRING_PTR(rbData),
+             RSTRING_LEN(rbData));
+  }
+  return rbData;
+}
+
 void
 strb_InitializeSdlAudio(void)
 {
-  if (Mix_OpenAudio(MIX_DEFAULT_FREQUENCY, MIX_DEFAULT_FORMAT, 2, 1024)) {
+  const char* sdlAudioDriver = getenv("SDL_AUDIODRIVER");
+  if (sdlAudioDriver) {
+    defaultSdlAudioDriver = CopyString(sdlAudioDriver);
+  }
+  const char* driver = getenv("STARRUBY_AUDIO_DRIVER");
+  if (driver && !strcmp(driver, "null")) {
+    SetAudioDriver(AUDIO_DRIVER_NULL);
+  } else if (driver && !strcmp(driver, "offline")) {
+    SetAudioDriver(AUDIO_DRIVER_OFFLINE);
+  }
+  if (!OpenAudio()) {
     rb_io_puts(1, (VALUE[]) {rb_str_new2(Mix_GetError())}, rb_stderr);
-    isEnabled = false;
-  } else {
-    Mix_AllocateChannels(MAX_CHANNEL_COUNT);
-    Mix_HookMusicFinished(SdlMusicFinished);
-    isEnabled = true;
   }
+  SetChannelCount(channelCount);
 }
 
 VALUE
@@ -282,6 +1452,22 @@ strb_InitializeAudio(VALUE rb_mStarRuby)
                             Audio_bgm_volume, 0);
   rb_define_module_function(rb_mAudio, "bgm_volume=",
                             Audio_bgm_volume_eq, 1);
+  rb_define_module_function(rb_mAudio, "buffer_size",
+                            Audio_buffer_size, 0);
+  rb_define_module_function(rb_mAudio, "chunk_cache_limit",
+                            Audio_chunk_cache_limit, 0);
+  rb_define_module_function(rb_mAudio, "chunk_cache_limit=",
+                            Audio_chunk_cache_limit_eq, 1);
+  rb_define_module_function(rb_mAudio, "chunk_cache_stats",
+                            Audio_chunk_cache_stats, 0);
+  rb_define_module_function(rb_mAudio, "driver",
+                            Audio_driver, 0);
+  rb_define_module_function(rb_mAudio, "enabled?",
+                            Audio_enabled, 0);
+  rb_define_module_function(rb_mAudio, "frequency",
+                            Audio_frequency, 0);
+  rb_define_module_function(rb_mAudio, "open",
+                            Audio_open, -1);
   rb_define_module_function(rb_mAudio, "play_bgm",
                             Audio_play_bgm, -1);
   rb_define_module_function(rb_mAudio, "play_se",
@@ -290,18 +1476,71 @@ strb_InitializeAudio(VALUE rb_mStarRuby)
                             Audio_playing_bgm, 0);
   rb_define_module_function(rb_mAudio, "playing_se_count",
                             Audio_playing_se_count, 0);
+  rb_define_module_function(rb_mAudio, "preload",
+                            Audio_preload, -1);
+  rb_define_module_function(rb_mAudio, "render",
+                            Audio_render, -1);
+  rb_define_module_function(rb_mAudio, "se_channel_count",
+                            Audio_se_channel_count, 0);
+  rb_define_module_function(rb_mAudio, "se_channel_count=",
+                            Audio_se_channel_count_eq, 1);
   rb_define_module_function(rb_mAudio, "stop_all_ses",
                             Audio_stop_all_ses, -1);
   rb_define_module_function(rb_mAudio, "stop_bgm",
                             Audio_stop_bgm, -1);
+  rb_define_module_function(rb_mAudio, "voice_stats",
+                            Audio_voice_stats, 0);
 
   rb_define_const(rb_mAudio, "MAX_SE_COUNT", INT2FIX(MAX_CHANNEL_COUNT));
 
-  symbol_loop     = ID2SYM(rb_intern("loop"));
-  symbol_panning  = ID2SYM(rb_intern("panning"));
-  symbol_position = ID2SYM(rb_intern("position"));
-  symbol_time     = ID2SYM(rb_intern("time"));
-  symbol_volume   = ID2SYM(rb_intern("volume"));
+  rb_cSoundEffect = rb_define_class_under(rb_mAudio, "SoundEffect",
+                                          rb_cObject);
+  rb_undef_alloc_func(rb_cSoundEffect);
+  rb_define_singleton_method(rb_cSoundEffect, "load", SoundEffect_s_load, 1);
+  rb_define_method(rb_cSoundEffect, "bytes",   SoundEffect_bytes,  0);
+  rb_define_method(rb_cSoundEffect, "loaded?", SoundEffect_loaded, 0);
+  rb_define_method(rb_cSoundEffect, "path",    SoundEffect_path,   0);
+  rb_define_method(rb_cSoundEffect, "play",    SoundEffect_play,   -1);
+
+  VALUE rb_cStream = rb_define_class_under(rb_mAudio, "Stream", rb_cObject);
+  rb_define_alloc_func(rb_cStream, AudioStream_alloc);
+  rb_define_private_method(rb_cStream, "initialize",
+                           AudioStream_initialize, -1);
+  rb_define_method(rb_cStream, "buffer_size", AudioStream_buffer_size, 0);
+  rb_define_method(rb_cStream, "play",        AudioStream_play,        0);
+  rb_define_method(rb_cStream, "playing?",    AudioStream_playing,     0);
+  rb_define_method(rb_cStream, "queued_frames",
+                   AudioStream_queued_frames, 0);
+  rb_define_method(rb_cStream, "stop",        AudioStream_stop,        0);
+  rb_define_method(rb_cStream, "underrun_frames",
+                   AudioStream_underrun_frames, 0);
+  rb_define_method(rb_cStream, "underruns",   AudioStream_underruns,   0);
+  rb_define_method(rb_cStream, "volume",      AudioStream_volume,      0);
+  rb_define_method(rb_cStream, "volume=",     AudioStream_volume_eq,   1);
+  rb_define_method(rb_cStream, "write",       AudioStream_write,       1);
+
+  symbol_buffer_size = ID2SYM(rb_intern("buffer_size"));
+  symbol_bytes       = ID2SYM(rb_intern("bytes"));
+  symbol_channels    = ID2SYM(rb_intern("channels"));
+  symbol_chunks      = ID2SYM(rb_intern("chunks"));
+  symbol_coalesced   = ID2SYM(rb_intern("coalesced"));
+  symbol_default     = ID2SYM(rb_intern("default"));
+  symbol_driver      = ID2SYM(rb_intern("driver"));
+  symbol_dropped     = ID2SYM(rb_intern("dropped"));
+  symbol_evictions   = ID2SYM(rb_intern("evictions"));
+  symbol_frequency   = ID2SYM(rb_intern("frequency"));
+  symbol_hits        = ID2SYM(rb_intern("hits"));
+  symbol_loop        = ID2SYM(rb_intern("loop"));
+  symbol_misses      = ID2SYM(rb_intern("misses"));
+  symbol_null        = ID2SYM(rb_intern("null"));
+  symbol_offline     = ID2SYM(rb_intern("offline"));
+  symbol_panning     = ID2SYM(rb_intern("panning"));
+  symbol_path        = ID2SYM(rb_intern("path"));
+  symbol_position    = ID2SYM(rb_intern("position"));
+  symbol_priority    = ID2SYM(rb_intern("priority"));
+  symbol_stolen      = ID2SYM(rb_intern("stolen"));
+  symbol_time        = ID2SYM(rb_intern("time"));
+  symbol_volume      = ID2SYM(rb_intern("volume"));
 
   Audio_bgm_volume_eq(rb_mAudio, INT2FIX(255));
 
@@ -311,30 +1550,14 @@ strb_InitializeAudio(VALUE rb_mStarRuby)
   return rb_mAudio;
 }
 
-static int
-FreeChunkCacheItem(VALUE rbKey, VALUE rbValue)
-{
-  Mix_Chunk* chunk = (Mix_Chunk*)NUM2ULONG(rbValue);
-  if (chunk) {
-    Mix_FreeChunk(chunk);
-  }
-  return ST_CONTINUE;
-}
-
-static int
-FreeMusicCacheItem(VALUE rbKey, VALUE rbValue)
-{
-  Mix_Music* music = (Mix_Music*)NUM2ULONG(rbValue);
-  if (music) {
-    Mix_FreeMusic(music);
-  }
-  return ST_CONTINUE;
-}
-
 void
 strb_FinalizeAudio(void)
 {
-  rb_hash_foreach(rbChunkCache, FreeChunkCacheItem, 0);
-  rb_hash_foreach(rbMusicCache, FreeMusicCacheItem, 0);
-  Mix_CloseAudio();
+  CloseAudio();
+  if (renderSem) {
+    SDL_DestroySemaphore(renderSem);
+    renderSem = NULL;
+  }
+  free(defaultSdlAudioDriver);
+  defaultSdlAudioDriver = NULL;
 }
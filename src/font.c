@@ -2,24 +2,50 @@
 
 #ifdef HAVE_FONTCONFIG_FONTCONFIG_H
 #include <fontconfig/fontconfig.h>
+#include <strings.h>
+#include <sys/stat.h>
 #endif
 #ifdef WIN32
 static volatile VALUE rbWindowsFontDirPathSymbol = Qundef;
 #endif
 
+#if SDL_TTF_MAJOR_VERSION > 2 ||                                     \
+  (SDL_TTF_MAJOR_VERSION == 2 &&                                       \
+   (SDL_TTF_MINOR_VERSION > 0 || 12 <= SDL_TTF_PATCHLEVEL))
+#define HAVE_TTF_GETFONTKERNINGSIZE
+#endif
+
 static VALUE rbFontCache = Qundef;
 
-static volatile VALUE symbol_bold      = Qundef;
-static volatile VALUE symbol_italic    = Qundef;
-static volatile VALUE symbol_ttc_index = Qundef;
+static size_t glyphCacheLimit = 512 * 1024;
 
-typedef struct FontFileInfo {
-  VALUE rbFontNameSymbol;
-  VALUE rbFileNameSymbol;
-  int ttcIndex;
-  struct FontFileInfo* next;
-} FontFileInfo;
-static FontFileInfo* fontFileInfos;
+#define LAYOUT_CACHE_SIZE (256)
+
+static volatile VALUE symbol_align        = Qundef;
+static volatile VALUE symbol_bold         = Qundef;
+static volatile VALUE symbol_bytes        = Qundef;
+static volatile VALUE symbol_center       = Qundef;
+static volatile VALUE symbol_evictions    = Qundef;
+static volatile VALUE symbol_glyphs       = Qundef;
+static volatile VALUE symbol_hits         = Qundef;
+static volatile VALUE symbol_italic       = Qundef;
+static volatile VALUE symbol_left         = Qundef;
+static volatile VALUE symbol_line_spacing = Qundef;
+static volatile VALUE symbol_misses       = Qundef;
+static volatile VALUE symbol_right        = Qundef;
+static volatile VALUE symbol_ttc_index    = Qundef;
+static volatile VALUE symbol_width        = Qundef;
+
+/*
+ * Font names are looked up in a Hash built once:
+ *   key:   a font name ("family" or "family,style")
+ *   value: [file path, TTC index (-1 if not specified)]
+ */
+static VALUE rbFontIndex = Qundef;
+static VALUE rbFontIndexCachePath = Qnil;
+#ifdef HAVE_FONTCONFIG_FONTCONFIG_H
+static bool isFontIndexBuilt = false;
+#endif
 
 static void Font_free(Font*);
 inline void
@@ -33,63 +59,134 @@ strb_CheckFont(VALUE rbFont)
 }
 
 static void
-SearchFont(VALUE rbFilePathOrName,
-           VALUE* volatile rbRealFilePath, int* ttcIndex)
+AddFontIndexEntry(VALUE rbKey, VALUE rbFilePath, int ttcIndex)
 {
-  *rbRealFilePath = Qnil;
-  if (ttcIndex != NULL) {
-    *ttcIndex = -1;
+  volatile VALUE rbEntry = rb_ary_new3(2, rbFilePath, INT2NUM(ttcIndex));
+  OBJ_FREEZE(rbEntry);
+  rb_hash_aset(rbFontIndex, rbKey, rbEntry);
+}
+
+#ifdef HAVE_FONTCONFIG_FONTCONFIG_H
+/*
+ * Fontconfig compares family and style names ignoring case and blanks
+ */
+static void
+AppendNormalizedName(VALUE rbKey, const char* name, int length)
+{
+  for (int i = 0; i < length; i++) {
+    const char c = name[i];
+    if (c != ' ' && c != '\t') {
+      const char lower = ('A' <= c && c <= 'Z') ? (c - 'A' + 'a') : c;
+      rb_str_cat(rbKey, &lower, 1);
+    }
   }
-  *rbRealFilePath = strb_GetCompletePath(rbFilePathOrName, false);
-  if (!NIL_P(*rbRealFilePath)) {
-    return;
+}
+
+static VALUE
+GetFontIndexKey(const char* family, const char* style)
+{
+  volatile VALUE rbKey = rb_str_new2("");
+  AppendNormalizedName(rbKey, family, strlen(family));
+  if (style) {
+    volatile VALUE rbStyle = rb_str_new2("");
+    AppendNormalizedName(rbStyle, style, strlen(style));
+    if (0 < RSTRING_LEN(rbStyle)) {
+      rb_str_cat2(rbKey, ",");
+      rb_str_concat(rbKey, rbStyle);
+    }
   }
-  volatile VALUE rbFontNameSymbol =
-    ID2SYM(rb_intern_str(rbFilePathOrName));
-  FontFileInfo* info = fontFileInfos;
-  while (info) {
-    if (info->rbFontNameSymbol == rbFontNameSymbol) {
-      *rbRealFilePath = rb_str_new2(rb_id2name(SYM2ID(info->rbFileNameSymbol)));
-#ifdef WIN32
-      volatile VALUE rbTemp =
-        rb_str_new2(rb_id2name(SYM2ID(rbWindowsFontDirPathSymbol)));
-      *rbRealFilePath = rb_str_concat(rb_str_cat2(rbTemp, "\\"), *rbRealFilePath);
-#endif
-      if (ttcIndex != NULL) {
-        *ttcIndex = info->ttcIndex;
+  return rbKey;
+}
+
+static bool
+IsRegularStyle(const char* style)
+{
+  static const char* regularStyles[] = {"regular", "normal", "book", "roman"};
+  for (int i = 0; i < (int)(sizeof(regularStyles) / sizeof(char*)); i++) {
+    if (!strcasecmp(style, regularStyles[i])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static long
+GetFontConfigTimestamp(void)
+{
+  FcConfig* config = FcConfigGetCurrent();
+  FcStrList* lists[] = {
+    FcConfigGetConfigFiles(config),
+    FcConfigGetFontDirs(config),
+  };
+  long timestamp = 0;
+  for (int i = 0; i < (int)(sizeof(lists) / sizeof(FcStrList*)); i++) {
+    if (!lists[i]) {
+      continue;
+    }
+    FcChar8* path;
+    while ((path = FcStrListNext(lists[i]))) {
+      struct stat st;
+      if (!stat((const char*)path, &st) && timestamp < (long)st.st_mtime) {
+        timestamp = st.st_mtime;
       }
-      return;
     }
-    info = info->next;
+    FcStrListDone(lists[i]);
+  }
+  return timestamp;
+}
+
+static VALUE
+LoadFontIndexCache(VALUE rbTimestamp)
+{
+  volatile VALUE rbData =
+    rb_funcall(rb_cFile, rb_intern("binread"), 1, rbFontIndexCachePath);
+  volatile VALUE rbCache = rb_marshal_load(rbData);
+  if (TYPE(rbCache) != T_ARRAY || RARRAY_LEN(rbCache) != 2 ||
+      !rb_equal(rb_ary_entry(rbCache, 0), rbTimestamp) ||
+      TYPE(rb_ary_entry(rbCache, 1)) != T_HASH) {
+    return Qfalse;
+  }
+  rb_funcall(rbFontIndex, rb_intern("replace"), 1, rb_ary_entry(rbCache, 1));
+  return Qtrue;
+}
+
+static VALUE
+SaveFontIndexCache(VALUE rbTimestamp)
+{
+  volatile VALUE rbCache = rb_ary_new3(2, rbTimestamp, rbFontIndex);
+  rb_funcall(rb_cFile, rb_intern("binwrite"), 2,
+             rbFontIndexCachePath, rb_marshal_dump(rbCache, Qnil));
+  return Qnil;
+}
+
+static void
+BuildFontIndex(void)
+{
+  if (isFontIndexBuilt) {
+    return;
   }
-#ifdef HAVE_FONTCONFIG_FONTCONFIG_H
   if (!FcInit()) {
     FcFini();
     rb_raise(strb_GetStarRubyErrorClass(), "can't initialize fontconfig library");
     return;
   }
-  int nameLength = RSTRING_LEN(rbFilePathOrName) + 1;
-  char name[nameLength];
-  strncpy(name, StringValueCStr(rbFilePathOrName), nameLength);
-  char* delimiter = strchr(name, ',');
-  char* style = NULL;
-  if (delimiter) {
-    *delimiter = '\0';
-    style = delimiter + 1;
-    char* nameTail = delimiter - 1;
-    while (*nameTail == ' ') {
-      *nameTail = '\0';
-      nameTail--;
+  isFontIndexBuilt = true;
+  rb_hash_clear(rbFontIndex);
+  volatile VALUE rbTimestamp = LONG2NUM(GetFontConfigTimestamp());
+  int state = 0;
+  if (!NIL_P(rbFontIndexCachePath)) {
+    // A broken or missing cache file is simply rebuilt
+    if (RTEST(rb_protect(LoadFontIndexCache, rbTimestamp, &state))) {
+      FcFini();
+      return;
     }
-    while (*style == ' ') {
-      style++;
+    if (state) {
+      rb_set_errinfo(Qnil);
     }
   }
-  FcPattern* pattern = FcPatternBuild(NULL, FC_FAMILY, FcTypeString, name, NULL);
-  if (style && 0 < strlen(style)) {
-    FcPatternAddString(pattern, FC_STYLE, (FcChar8*)style);
-  }
-  FcObjectSet* objectSet = FcObjectSetBuild(FC_FAMILY, FC_FILE, NULL);
+  FcPattern* pattern = FcPatternCreate();
+  FcObjectSet* objectSet =
+    FcObjectSetBuild(FC_FAMILY, FC_STYLE, FC_FILE, FC_INDEX, NULL);
   FcFontSet* fontSet = FcFontList(NULL, pattern, objectSet);
   if (objectSet) {
     FcObjectSetDestroy(objectSet);
@@ -99,27 +196,287 @@ SearchFont(VALUE rbFilePathOrName,
   }
   if (fontSet) {
     for (int i = 0; i < fontSet->nfont; i++) {
+      const FcPattern* font = fontSet->fonts[i];
       FcChar8* fileName = NULL;
-      if (FcPatternGetString(fontSet->fonts[i], FC_FILE, 0, &fileName) ==
-          FcResultMatch) {
-        FcChar8* fontName = FcNameUnparse(fontSet->fonts[i]);
-        *rbRealFilePath = rb_str_new2((char*)fileName);
-        volatile VALUE rbFontName = rb_str_new2((char*)fontName);
-        free(fontName);
-        fontName = NULL;
-        if (ttcIndex != NULL && strchr(StringValueCStr(rbFontName), ',')) {
-          *ttcIndex = 0;
+      if (FcPatternGetString(font, FC_FILE, 0, &fileName) != FcResultMatch) {
+        continue;
+      }
+      int index = 0;
+      FcPatternGetInteger(font, FC_INDEX, 0, &index);
+      // Faces other than the first of a TTC override :ttc_index
+      const int ttcIndex = index ? index : -1;
+      volatile VALUE rbFilePath = rb_str_new2((char*)fileName);
+      OBJ_FREEZE(rbFilePath);
+      FcChar8* family = NULL;
+      for (int j = 0;
+           FcPatternGetString(font, FC_FAMILY, j, &family) == FcResultMatch;
+           j++) {
+        bool isRegular = false;
+        FcChar8* style = NULL;
+        for (int k = 0;
+             FcPatternGetString(font, FC_STYLE, k, &style) == FcResultMatch;
+             k++) {
+          AddFontIndexEntry(GetFontIndexKey((char*)family, (char*)style),
+                            rbFilePath, ttcIndex);
+          isRegular |= IsRegularStyle((char*)style);
+        }
+        volatile VALUE rbKey = GetFontIndexKey((char*)family, NULL);
+        if (isRegular || NIL_P(rb_hash_lookup(rbFontIndex, rbKey))) {
+          AddFontIndexEntry(rbKey, rbFilePath, -1);
         }
       }
     }
     FcFontSetDestroy(fontSet);
   }
   FcFini();
+  if (!NIL_P(rbFontIndexCachePath)) {
+    rb_protect(SaveFontIndexCache, rbTimestamp, &state);
+    if (state) {
+      rb_set_errinfo(Qnil);
+    }
+  }
+}
+#endif
+
+static void
+SearchFont(VALUE rbFilePathOrName,
+           VALUE* volatile rbRealFilePath, int* ttcIndex)
+{
+  *rbRealFilePath = Qnil;
+  if (ttcIndex != NULL) {
+    *ttcIndex = -1;
+  }
+  *rbRealFilePath = strb_GetCompletePath(rbFilePathOrName, false);
   if (!NIL_P(*rbRealFilePath)) {
     return;
   }
+#ifdef HAVE_FONTCONFIG_FONTCONFIG_H
+  BuildFontIndex();
+  const char* name = StringValueCStr(rbFilePathOrName);
+  volatile VALUE rbKey;
+  const char* delimiter = strchr(name, ',');
+  if (delimiter) {
+    volatile VALUE rbFamily = rb_str_new(name, delimiter - name);
+    rbKey = GetFontIndexKey(StringValueCStr(rbFamily), delimiter + 1);
+  } else {
+    rbKey = GetFontIndexKey(name, NULL);
+  }
+#else
+  volatile VALUE rbKey = rbFilePathOrName;
+#endif
+  volatile VALUE rbEntry = rb_hash_lookup(rbFontIndex, rbKey);
+  if (NIL_P(rbEntry)) {
+    return;
+  }
+  *rbRealFilePath = rb_str_dup(rb_ary_entry(rbEntry, 0));
+#ifdef WIN32
+  volatile VALUE rbTemp =
+    rb_str_new2(rb_id2name(SYM2ID(rbWindowsFontDirPathSymbol)));
+  *rbRealFilePath = rb_str_concat(rb_str_cat2(rbTemp, "\\"), *rbRealFilePath);
+#endif
+  if (ttcIndex != NULL) {
+    *ttcIndex = NUM2INT(rb_ary_entry(rbEntry, 1));
+  }
+}
+
+uint32_t
+strb_GetNextCodepoint(const char** text)
+{
+  const uint8_t* s = (const uint8_t*)*text;
+  uint32_t codepoint = s[0];
+  int length;
+  if (codepoint < 0x80) {
+    length = 1;
+  } else if ((codepoint & 0xe0) == 0xc0) {
+    codepoint &= 0x1f;
+    length = 2;
+  } else if ((codepoint & 0xf0) == 0xe0) {
+    codepoint &= 0x0f;
+    length = 3;
+  } else if ((codepoint & 0xf8) == 0xf0) {
+    codepoint &= 0x07;
+    length = 4;
+  } else {
+    *text += 1;
+    return 0xfffd;
+  }
+  for (int i = 1; i < length; i++) {
+    if ((s[i] & 0xc0) != 0x80) {
+      *text += i;
+      return 0xfffd;
+    }
+    codepoint = (codepoint << 6) | (s[i] & 0x3f);
+  }
+  *text += length;
+  return codepoint;
+}
+
+inline static size_t
+GetGlyphBytes(const Glyph* glyph)
+{
+  return sizeof(Glyph) + glyph->width * glyph->height;
+}
+
+static void
+UnlinkGlyph(Font* font, Glyph* glyph)
+{
+  if (glyph->prev) {
+    glyph->prev->next = glyph->next;
+  } else {
+    font->newestGlyph = glyph->next;
+  }
+  if (glyph->next) {
+    glyph->next->prev = glyph->prev;
+  } else {
+    font->oldestGlyph = glyph->prev;
+  }
+  glyph->prev = glyph->next = NULL;
+}
+
+static void
+LinkNewestGlyph(Font* font, Glyph* glyph)
+{
+  glyph->prev = NULL;
+  glyph->next = font->newestGlyph;
+  if (font->newestGlyph) {
+    font->newestGlyph->prev = glyph;
+  } else {
+    font->oldestGlyph = glyph;
+  }
+  font->newestGlyph = glyph;
+}
+
+static void
+TrimGlyphCache(Font* font, size_t limit, const Glyph* keptGlyph)
+{
+  while (limit < font->glyphBytes && font->oldestGlyph &&
+         font->oldestGlyph != keptGlyph) {
+    Glyph* glyph = font->oldestGlyph;
+    UnlinkGlyph(font, glyph);
+    Glyph** g = &(font->glyphBuckets[glyph->codepoint % GLYPH_BUCKET_COUNT]);
+    while (*g != glyph) {
+      g = &((*g)->hashNext);
+    }
+    *g = glyph->hashNext;
+    font->glyphBytes -= GetGlyphBytes(glyph);
+    font->glyphCount--;
+    font->glyphEvictions++;
+    xfree(glyph);
+  }
+}
+
+// SDL_ttf only takes characters in the BMP
+inline static Uint16
+GetSdlCharacter(uint32_t codepoint)
+{
+  return (codepoint <= 0xffff) ? codepoint : 0xfffd;
+}
+
+inline static int
+GetGlyphIndex(const Font* font, Uint16 ch)
+{
+#ifdef HAVE_TTF_GETFONTKERNINGSIZE
+  return TTF_GlyphIsProvided(font->sdlFont, ch);
+#else
+  return 0;
+#endif
+}
+
+static Glyph*
+RenderGlyph(const Font* font, uint32_t codepoint, bool antiAlias)
+{
+  const Uint16 ch = GetSdlCharacter(codepoint);
+  int minX = 0, maxY = 0, advance = 0;
+  SDL_Surface* surface = NULL;
+  if (!TTF_GlyphMetrics(font->sdlFont, ch,
+                        &minX, NULL, NULL, &maxY, &advance)) {
+    SDL_Surface* surfaceRaw;
+    if (antiAlias) {
+      surfaceRaw = TTF_RenderGlyph_Shaded(font->sdlFont, ch,
+                                          (SDL_Color){255, 255, 255, 255},
+                                          (SDL_Color){0, 0, 0, 0});
+    } else {
+      surfaceRaw = TTF_RenderGlyph_Solid(font->sdlFont, ch,
+                                         (SDL_Color){255, 255, 255, 255});
+    }
+    if (surfaceRaw) {
+      SDL_PixelFormat format = {
+        .palette = NULL, .BitsPerPixel = 32, .BytesPerPixel = 4,
+        .Rmask = 0x00ff0000, .Gmask = 0x0000ff00,
+        .Bmask = 0x000000ff, .Amask = 0xff000000,
+        .colorkey = 0, .alpha = 255,
+      };
+      surface = SDL_ConvertSurface(surfaceRaw, &format, SDL_SWSURFACE);
+      SDL_FreeSurface(surfaceRaw);
+      surfaceRaw = NULL;
+    }
+  }
+  // A glyph that can't be rendered is cached as an empty one
+  const int width  = surface ? surface->w : 0;
+  const int height = surface ? surface->h : 0;
+  Glyph* glyph = (Glyph*)ALLOC_N(uint8_t, sizeof(Glyph) + width * height);
+  glyph->codepoint = codepoint;
+  glyph->antiAlias = antiAlias;
+  glyph->index     = GetGlyphIndex(font, ch);
+  glyph->offsetX   = minX;
+  glyph->offsetY   = font->ascent - maxY;
+  glyph->width     = width;
+  glyph->height    = height;
+  glyph->advance   = advance;
+  glyph->hashNext  = NULL;
+  glyph->prev      = NULL;
+  glyph->next      = NULL;
+  if (surface) {
+    SDL_LockSurface(surface);
+    for (int j = 0; j < height; j++) {
+      const Pixel* src =
+        (Pixel*)((uint8_t*)surface->pixels + j * surface->pitch);
+      uint8_t* dst = &(glyph->coverage[j * width]);
+      for (int i = 0; i < width; i++, src++, dst++) {
+        *dst = src->color.red;
+      }
+    }
+    SDL_UnlockSurface(surface);
+    SDL_FreeSurface(surface);
+    surface = NULL;
+  }
+  return glyph;
+}
+
+const Glyph*
+strb_GetGlyph(Font* font, uint32_t codepoint, bool antiAlias)
+{
+  Glyph** bucket = &(font->glyphBuckets[codepoint % GLYPH_BUCKET_COUNT]);
+  for (Glyph* glyph = *bucket; glyph; glyph = glyph->hashNext) {
+    if (glyph->codepoint == codepoint && glyph->antiAlias == antiAlias) {
+      font->glyphHits++;
+      if (font->newestGlyph != glyph) {
+        UnlinkGlyph(font, glyph);
+        LinkNewestGlyph(font, glyph);
+      }
+      return glyph;
+    }
+  }
+  font->glyphMisses++;
+  Glyph* glyph = RenderGlyph(font, codepoint, antiAlias);
+  glyph->hashNext = *bucket;
+  *bucket = glyph;
+  LinkNewestGlyph(font, glyph);
+  font->glyphBytes += GetGlyphBytes(glyph);
+  font->glyphCount++;
+  TrimGlyphCache(font, glyphCacheLimit, glyph);
+  return glyph;
+}
+
+int
+strb_GetKerning(const Font* font, int prevIndex, int index)
+{
+#ifdef HAVE_TTF_GETFONTKERNINGSIZE
+  if (prevIndex && index) {
+    return TTF_GetFontKerningSize(font->sdlFont, prevIndex, index);
+  }
 #endif
-  return;
+  return 0;
 }
 
 static VALUE
@@ -130,9 +487,53 @@ Font_s_exist(VALUE self, VALUE rbFilePath)
   return !NIL_P(rbRealFilePath) ? Qtrue : Qfalse;
 }
 
+static VALUE
+Font_s_index_cache_path(VALUE self)
+{
+  return rbFontIndexCachePath;
+}
+
+static VALUE
+Font_s_index_cache_path_eq(VALUE self, VALUE rbPath)
+{
+  if (!NIL_P(rbPath)) {
+    rbPath = rb_str_new_frozen(StringValue(rbPath));
+  }
+  rbFontIndexCachePath = rbPath;
+#ifdef HAVE_FONTCONFIG_FONTCONFIG_H
+  // The index is reloaded from (or saved to) the new path on the next lookup
+  isFontIndexBuilt = false;
+#endif
+  return rbPath;
+}
+
+static VALUE
+Font_s_glyph_cache_limit(VALUE self)
+{
+  return ULONG2NUM(glyphCacheLimit);
+}
+
+static VALUE
+Font_s_glyph_cache_limit_eq(VALUE self, VALUE rbLimit)
+{
+  const long limit = NUM2LONG(rbLimit);
+  if (limit < 0) {
+    rb_raise(rb_eArgError, "invalid glyph cache limit: %ld", limit);
+  }
+  glyphCacheLimit = limit;
+  volatile VALUE rbFonts = rb_funcall(rbFontCache, rb_intern("values"), 0);
+  for (int i = 0; i < RARRAY_LEN(rbFonts); i++) {
+    Font* font;
+    Data_Get_Struct(rb_ary_entry(rbFonts, i), Font, font);
+    TrimGlyphCache(font, glyphCacheLimit, NULL);
+  }
+  return rbLimit;
+}
+
 static void
 Font_free(Font* font)
 {
+  TrimGlyphCache(font, 0, NULL);
   if (TTF_WasInit()) {
     TTF_CloseFont(font->sdlFont);
   }
@@ -173,26 +574,13 @@ Font_s_new(int argc, VALUE* argv, VALUE self)
   } else if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_ttc_index))) {
     ttcIndex = NUM2INT(val);
   }
-  volatile VALUE rbHashKey = rb_str_dup(rbRealFilePath);  
-  char temp[256];
-  // TODO: change the delimiter or the way to name a hash key
-  rb_str_cat2(rbHashKey, ";size=");
-  snprintf(temp, sizeof(temp), "%d", size);
-  rb_str_cat2(rbHashKey, temp);
-  if (bold) {
-    rb_str_cat2(rbHashKey, ";bold=true");
-  } else {
-    rb_str_cat2(rbHashKey, ";bold=false");
-  }
-  if (italic) {
-    rb_str_cat2(rbHashKey, ";italic=true");
-  } else {
-    rb_str_cat2(rbHashKey, ";italic=false");
-  }
-  rb_str_cat2(rbHashKey, ";ttc_index=");
-  snprintf(temp, sizeof(temp), "%d", ttcIndex);
-  rb_str_cat2(rbHashKey, temp);
-
+  volatile VALUE rbHashKey = rb_ary_new3(5,
+                                         rb_str_new_frozen(rbRealFilePath),
+                                         INT2NUM(size),
+                                         bold ? Qtrue : Qfalse,
+                                         italic ? Qtrue : Qfalse,
+                                         INT2NUM(ttcIndex));
+  OBJ_FREEZE(rbHashKey);
   if (!NIL_P(val = rb_hash_aref(rbFontCache, rbHashKey))) {
     return val;
   } else {
@@ -210,12 +598,20 @@ Font_s_new(int argc, VALUE* argv, VALUE self)
   }
 }
 
+static void
+Font_mark(Font* font)
+{
+  rb_gc_mark(font->rbLayoutCache);
+}
+
 static VALUE
 Font_alloc(VALUE klass)
 {
   Font* font = ALLOC(Font);
+  MEMZERO(font, Font, 1);
   font->sdlFont = NULL;
-  return Data_Wrap_Struct(klass, 0, Font_free, font);
+  font->rbLayoutCache = Qnil;
+  return Data_Wrap_Struct(klass, Font_mark, Font_free, font);
 }
 
 static VALUE
@@ -238,6 +634,7 @@ Font_initialize(VALUE self, VALUE rbRealFilePath, VALUE rbSize,
   const int style = TTF_STYLE_NORMAL |
     (bold ? TTF_STYLE_BOLD : 0) | (italic ? TTF_STYLE_ITALIC : 0);
   TTF_SetFontStyle(font->sdlFont, style);
+  font->ascent = TTF_FontAscent(font->sdlFont);
 
   return Qnil;
 }
@@ -250,6 +647,21 @@ Font_bold(VALUE self)
   return (TTF_GetFontStyle(font->sdlFont) & TTF_STYLE_BOLD) ? Qtrue : Qfalse;
 }
 
+static VALUE
+Font_glyph_cache_stats(VALUE self)
+{
+  const Font* font;
+  Data_Get_Struct(self, Font, font);
+  volatile VALUE rbStats = rb_hash_new();
+  rb_hash_aset(rbStats, symbol_glyphs,    INT2NUM(font->glyphCount));
+  rb_hash_aset(rbStats, symbol_bytes,     ULONG2NUM(font->glyphBytes));
+  rb_hash_aset(rbStats, symbol_hits,      ULONG2NUM(font->glyphHits));
+  rb_hash_aset(rbStats, symbol_misses,    ULONG2NUM(font->glyphMisses));
+  rb_hash_aset(rbStats, symbol_evictions, ULONG2NUM(font->glyphEvictions));
+  OBJ_FREEZE(rbStats);
+  return rbStats;
+}
+
 static VALUE
 Font_italic(VALUE self)
 {
@@ -273,6 +685,167 @@ Font_get_size(VALUE self, VALUE rbText)
   return rbSize;
 }
 
+static void
+AddLine(VALUE rbLines, VALUE rbText, const char* text,
+        const char* begin, const char* end, int width)
+{
+  volatile VALUE rbLine = rb_ary_new3(2,
+                                      rb_str_substr(rbText, begin - text,
+                                                    end - begin),
+                                      INT2NUM(width));
+  rb_ary_push(rbLines, rbLine);
+}
+
+static VALUE
+LayoutText(Font* font, VALUE rbText, int maxWidth, VALUE rbAlign,
+           int lineSpacing)
+{
+  const char* text = StringValueCStr(rbText);
+  volatile VALUE rbLines = rb_ary_new();
+  const char* lineBegin = text;
+  const char* breakEnd = NULL;
+  const char* breakNext = NULL;
+  int breakWidth = 0;
+  int penX = 0;
+  int contentWidth = 0;
+  int prevIndex = 0;
+  const char* p = text;
+  for (;;) {
+    const char* current = p;
+    const uint32_t codepoint = strb_GetNextCodepoint(&p);
+    if (codepoint == 0 || codepoint == '\n') {
+      AddLine(rbLines, rbText, text, lineBegin, current, contentWidth);
+      if (codepoint == 0) {
+        break;
+      }
+      lineBegin = p;
+      breakEnd = breakNext = NULL;
+      penX = contentWidth = prevIndex = 0;
+      continue;
+    }
+    // Only the metrics are needed, so no glyph is rendered for layouts
+    const Uint16 ch = GetSdlCharacter(codepoint);
+    const int index = GetGlyphIndex(font, ch);
+    int glyphAdvance = 0;
+    TTF_GlyphMetrics(font->sdlFont, ch, NULL, NULL, NULL, NULL, &glyphAdvance);
+    const int advance = strb_GetKerning(font, prevIndex, index) + glyphAdvance;
+    if (codepoint == ' ') {
+      breakEnd   = current;
+      breakNext  = p;
+      breakWidth = contentWidth;
+    } else if (0 < maxWidth && maxWidth < penX + advance &&
+               lineBegin < current) {
+      // Wrap at the last space, or before this character for a long word
+      if (breakEnd) {
+        AddLine(rbLines, rbText, text, lineBegin, breakEnd, breakWidth);
+        p = breakNext;
+      } else {
+        AddLine(rbLines, rbText, text, lineBegin, current, contentWidth);
+        p = current;
+      }
+      while (*p == ' ') {
+        p++;
+      }
+      lineBegin = p;
+      breakEnd = breakNext = NULL;
+      penX = contentWidth = prevIndex = 0;
+      continue;
+    }
+    penX += advance;
+    if (codepoint != ' ') {
+      contentWidth = penX;
+    }
+    prevIndex = index;
+  }
+
+  const int lineCount = RARRAY_LEN(rbLines);
+  int blockWidth = maxWidth;
+  if (blockWidth <= 0) {
+    blockWidth = 0;
+    for (int i = 0; i < lineCount; i++) {
+      const int width = NUM2INT(rb_ary_entry(rb_ary_entry(rbLines, i), 1));
+      blockWidth = MAX(blockWidth, width);
+    }
+  }
+  const int lineHeight = TTF_FontLineSkip(font->sdlFont) + lineSpacing;
+  for (int i = 0; i < lineCount; i++) {
+    volatile VALUE rbLine = rb_ary_entry(rbLines, i);
+    volatile VALUE rbLineText = rb_ary_entry(rbLine, 0);
+    const int width = NUM2INT(rb_ary_entry(rbLine, 1));
+    int x = 0;
+    if (rbAlign == symbol_center) {
+      x = (blockWidth - width) / 2;
+    } else if (rbAlign == symbol_right) {
+      x = blockWidth - width;
+    }
+    OBJ_FREEZE(rbLineText);
+    rbLine = rb_ary_new3(4, rbLineText, INT2NUM(x), INT2NUM(i * lineHeight),
+                         INT2NUM(width));
+    OBJ_FREEZE(rbLine);
+    rb_ary_store(rbLines, i, rbLine);
+  }
+  OBJ_FREEZE(rbLines);
+  return rbLines;
+}
+
+VALUE
+strb_GetTextLayout(VALUE rbFont, VALUE rbText, VALUE rbOptions)
+{
+  strb_CheckFont(rbFont);
+  Check_Type(rbText, T_STRING);
+  if (NIL_P(rbOptions)) {
+    rbOptions = rb_hash_new();
+  }
+  Check_Type(rbOptions, T_HASH);
+  int maxWidth = 0;
+  int lineSpacing = 0;
+  volatile VALUE rbAlign = symbol_left;
+  volatile VALUE val;
+  if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_width))) {
+    maxWidth = NUM2INT(val);
+    if (maxWidth <= 0) {
+      rb_raise(rb_eArgError, "width less than or equal to 0");
+    }
+  }
+  if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_align))) {
+    Check_Type(val, T_SYMBOL);
+    if (val != symbol_left && val != symbol_center && val != symbol_right) {
+      rb_raise(rb_eArgError, "invalid align: %s",
+               rb_id2name(SYM2ID(val)));
+    }
+    rbAlign = val;
+  }
+  if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_line_spacing))) {
+    lineSpacing = NUM2INT(val);
+  }
+  Font* font;
+  Data_Get_Struct(rbFont, Font, font);
+  if (NIL_P(font->rbLayoutCache)) {
+    font->rbLayoutCache = rb_hash_new();
+  }
+  volatile VALUE rbKey = rb_ary_new3(4, rb_str_new_frozen(rbText),
+                                     INT2NUM(maxWidth), rbAlign,
+                                     INT2NUM(lineSpacing));
+  volatile VALUE rbLines = rb_hash_aref(font->rbLayoutCache, rbKey);
+  if (!NIL_P(rbLines)) {
+    return rbLines;
+  }
+  rbLines = LayoutText(font, rbText, maxWidth, rbAlign, lineSpacing);
+  if (LAYOUT_CACHE_SIZE <= RHASH_SIZE(font->rbLayoutCache)) {
+    rb_hash_clear(font->rbLayoutCache);
+  }
+  rb_hash_aset(font->rbLayoutCache, rbKey, rbLines);
+  return rbLines;
+}
+
+static VALUE
+Font_layout(int argc, VALUE* argv, VALUE self)
+{
+  volatile VALUE rbText, rbOptions;
+  rb_scan_args(argc, argv, "11", &rbText, &rbOptions);
+  return strb_GetTextLayout(self, rbText, rbOptions);
+}
+
 static VALUE
 Font_name(VALUE self)
 {
@@ -289,31 +862,15 @@ Font_size(VALUE self)
   return INT2NUM(font->size);
 }
 
-#define ADD_INFO(currentInfo, _rbFontNameSymbol, \
-                 _rbFileNameSymbol, _ttcIndex)   \
-  do {                                           \
-    FontFileInfo* info = ALLOC(FontFileInfo);    \
-    info->rbFontNameSymbol = _rbFontNameSymbol;  \
-    info->rbFileNameSymbol = _rbFileNameSymbol;  \
-    info->ttcIndex         = _ttcIndex;          \
-    info->next             = NULL;               \
-    currentInfo->next = info;                    \
-    currentInfo = info;                          \
-  } while (false)
-
 void
 strb_InitializeSdlFont(void)
 {
   if (TTF_Init()) {
     rb_raise_sdl_ttf_error();
   }
-  fontFileInfos = ALLOC(FontFileInfo);
-  fontFileInfos->rbFontNameSymbol = Qundef;
-  fontFileInfos->rbFileNameSymbol = Qundef;
-  fontFileInfos->ttcIndex         = -1;
-  fontFileInfos->next             = NULL;
-  FontFileInfo* currentInfo = fontFileInfos;
-  (void)currentInfo;
+  rbFontIndex = rb_hash_new();
+  rb_gc_register_address(&rbFontIndex);
+  rb_gc_register_address(&rbFontIndexCachePath);
 
 #ifdef WIN32
   HKEY hKey;
@@ -385,17 +942,12 @@ strb_InitializeSdlFont(void)
               volatile VALUE rbFontName = rb_ary_entry(rbArr, i);
               rb_funcall(rbFontName, rb_intern("strip!"), 0);
               if (0 < RSTRING_LEN(rbFontName)) {
-                volatile VALUE rbFontNameSymbol = rb_str_intern(rbFontName);
-                volatile VALUE rbFileNameSymbol = rb_str_intern(rbFileName);
-                ADD_INFO(currentInfo, rbFontNameSymbol, rbFileNameSymbol,
-                         ttcIndex);
+                AddFontIndexEntry(rbFontName, rbFileName, ttcIndex);
                 ttcIndex++;
               }
             }
           } else {
-            volatile VALUE rbFontNameSymbol = rb_str_intern(rbFontName);
-            volatile VALUE rbFileNameSymbol = rb_str_intern(rbFileName);
-            ADD_INFO(currentInfo, rbFontNameSymbol, rbFileNameSymbol, -1);
+            AddFontIndexEntry(rbFontName, rbFileName, -1);
           }
         }
       } else {
@@ -435,17 +987,38 @@ strb_InitializeFont(VALUE rb_mStarRuby)
   VALUE rb_cFont = rb_define_class_under(rb_mStarRuby, "Font", rb_cObject);
   rb_define_singleton_method(rb_cFont, "exist?", Font_s_exist, 1);
   rb_define_singleton_method(rb_cFont, "new",    Font_s_new,   -1);
+  rb_define_singleton_method(rb_cFont, "glyph_cache_limit",
+                             Font_s_glyph_cache_limit, 0);
+  rb_define_singleton_method(rb_cFont, "glyph_cache_limit=",
+                             Font_s_glyph_cache_limit_eq, 1);
+  rb_define_singleton_method(rb_cFont, "index_cache_path",
+                             Font_s_index_cache_path, 0);
+  rb_define_singleton_method(rb_cFont, "index_cache_path=",
+                             Font_s_index_cache_path_eq, 1);
   rb_define_alloc_func(rb_cFont, Font_alloc);
   rb_define_private_method(rb_cFont, "initialize", Font_initialize, 5);
   rb_define_method(rb_cFont, "bold?",     Font_bold,     0);
   rb_define_method(rb_cFont, "get_size",  Font_get_size, 1);
+  rb_define_method(rb_cFont, "glyph_cache_stats", Font_glyph_cache_stats, 0);
   rb_define_method(rb_cFont, "italic?",   Font_italic,   0);
+  rb_define_method(rb_cFont, "layout",    Font_layout,   -1);
   rb_define_method(rb_cFont, "name",      Font_name,     0);
   rb_define_method(rb_cFont, "size",      Font_size,     0);
 
-  symbol_bold      = ID2SYM(rb_intern("bold"));
-  symbol_italic    = ID2SYM(rb_intern("italic"));
-  symbol_ttc_index = ID2SYM(rb_intern("ttc_index"));
+  symbol_align        = ID2SYM(rb_intern("align"));
+  symbol_bold         = ID2SYM(rb_intern("bold"));
+  symbol_bytes        = ID2SYM(rb_intern("bytes"));
+  symbol_center       = ID2SYM(rb_intern("center"));
+  symbol_evictions    = ID2SYM(rb_intern("evictions"));
+  symbol_glyphs       = ID2SYM(rb_intern("glyphs"));
+  symbol_hits         = ID2SYM(rb_intern("hits"));
+  symbol_italic       = ID2SYM(rb_intern("italic"));
+  symbol_left         = ID2SYM(rb_intern("left"));
+  symbol_line_spacing = ID2SYM(rb_intern("line_spacing"));
+  symbol_misses       = ID2SYM(rb_intern("misses"));
+  symbol_right        = ID2SYM(rb_intern("right"));
+  symbol_ttc_index    = ID2SYM(rb_intern("ttc_index"));
+  symbol_width        = ID2SYM(rb_intern("width"));
 
   rbFontCache = rb_hash_new();
   rb_gc_register_address(&rbFontCache);
@@ -1,14 +1,53 @@
 #include "starruby_private.h"
 
+// Idle tasks leave this margin (in milliseconds) before the frame deadline
+#define IDLE_MARGIN (1)
+
+// Larger values of max_frame_skip are clamped to this
+#define MAX_FRAME_SKIP (60)
+
 static volatile VALUE rb_cGame     = Qundef;
 static volatile VALUE rb_mStarRuby = Qundef;
 
-static volatile VALUE symbol_cursor       = Qundef;
-static volatile VALUE symbol_fps          = Qundef;
-static volatile VALUE symbol_fullscreen   = Qundef;
-static volatile VALUE symbol_title        = Qundef;
-static volatile VALUE symbol_vsync        = Qundef;
-static volatile VALUE symbol_window_scale = Qundef;
+static volatile VALUE symbol_brightness     = Qundef;
+static volatile VALUE symbol_color_matrix   = Qundef;
+static volatile VALUE symbol_consecutive    = Qundef;
+static volatile VALUE symbol_cursor         = Qundef;
+static volatile VALUE symbol_direct_screen  = Qundef;
+static volatile VALUE symbol_fps            = Qundef;
+static volatile VALUE symbol_fullscreen     = Qundef;
+static volatile VALUE symbol_max_frame_skip = Qundef;
+static volatile VALUE symbol_mosaic         = Qundef;
+static volatile VALUE symbol_present_thread = Qundef;
+static volatile VALUE symbol_rendered       = Qundef;
+static volatile VALUE symbol_saturation     = Qundef;
+static volatile VALUE symbol_skipped        = Qundef;
+static volatile VALUE symbol_title          = Qundef;
+static volatile VALUE symbol_tone_blue      = Qundef;
+static volatile VALUE symbol_tone_green     = Qundef;
+static volatile VALUE symbol_tone_red       = Qundef;
+static volatile VALUE symbol_vsync          = Qundef;
+static volatile VALUE symbol_window_scale   = Qundef;
+
+/*
+ * Effects applied while the screen is converted. The color matrix is in
+ * fixed point (256 is 1.0) and the tone and the brightness are folded
+ * into a table per channel.
+ */
+typedef struct {
+  bool isEnabled;
+  int brightness;
+  int toneRed;
+  int toneGreen;
+  int toneBlue;
+  int saturation;
+  int mosaic;
+  bool hasColorMatrix;
+  int colorMatrix[12];
+  uint8_t redTable[256];
+  uint8_t greenTable[256];
+  uint8_t blueTable[256];
+} ScreenEffects;
 
 typedef struct {
   Uint32 error;
@@ -24,11 +63,34 @@ typedef struct {
   SDL_Surface* sdlScreen;
   SDL_Surface* sdlScreenBuffer;
   GLuint glScreen;
+  int glScreenWidth;
+  int glScreenHeight;
+  bool isDirectScreen;
   int fps;
   double realFps;
   GameTimer timer;
   bool isWindowClosing;
   bool isVsync;
+  int maxFrameSkip;
+  int consecutiveSkips;
+  bool isFrameSkipped;
+  unsigned long skippedFrames;
+  unsigned long renderedFrames;
+  VALUE idleTasks;
+  ScreenEffects screenEffects;
+  ScreenEffects presentEffects;
+  bool isPresentThreaded;
+  SDL_Thread* presentThread;
+  SDL_sem* presentRequestSem;
+  SDL_sem* presentDoneSem;
+  volatile bool isPresentThreadQuitting;
+  Pixel* presentPixels;
+  size_t presentPixelsSize;
+  int presentWidth;
+  int presentHeight;
+  int presentPitch;
+  bool isPresentPending;
+  bool hasPresentFrame;
 } Game;
 
 inline static void
@@ -51,6 +113,263 @@ Power2(int x)
 
 static VALUE Game_s_current(VALUE);
 
+inline static uint8_t
+Clamp255(int x)
+{
+  return (x < 0) ? 0 : (255 < x) ? 255 : x;
+}
+
+static void
+InitializeScreenEffects(ScreenEffects* effects)
+{
+  effects->isEnabled      = false;
+  effects->brightness     = 255;
+  effects->toneRed        = 0;
+  effects->toneGreen      = 0;
+  effects->toneBlue       = 0;
+  effects->saturation     = 255;
+  effects->mosaic         = 1;
+  effects->hasColorMatrix = false;
+  for (int i = 0; i < 12; i++) {
+    effects->colorMatrix[i] = (i % 5 == 0) ? 256 : 0;
+  }
+}
+
+static void
+UpdateScreenEffects(ScreenEffects* effects)
+{
+  strb_BuildToneTable(effects->redTable,   effects->toneRed,
+                      effects->brightness);
+  strb_BuildToneTable(effects->greenTable, effects->toneGreen,
+                      effects->brightness);
+  strb_BuildToneTable(effects->blueTable,  effects->toneBlue,
+                      effects->brightness);
+  effects->isEnabled =
+    effects->brightness < 255 || effects->toneRed || effects->toneGreen ||
+    effects->toneBlue || effects->saturation < 255 || 1 < effects->mosaic ||
+    effects->hasColorMatrix;
+}
+
+/*
+ * Converts the screen texture into the upload buffer, multiplying
+ * colors by alpha since the screen is shown on black
+ */
+static void
+ConvertScreen(Pixel* dst, int dstPitch, const Pixel* src,
+              int textureWidth, int textureHeight, int texturePitch,
+              const ScreenEffects* effects)
+{
+  if (!effects->isEnabled) {
+    const int dstPadding = dstPitch - textureWidth;
+    const int srcPadding = texturePitch - textureWidth;
+    for (int j = 0; j < textureHeight; j++, src += srcPadding, dst += dstPadding) {
+      for (int i = 0; i < textureWidth; i++, src++, dst++) {
+        const uint8_t alpha = src->color.alpha;
+        if (alpha == 255) {
+          *dst = *src;
+        } else if (alpha) {
+          dst->color.red   = DIV255(src->color.red   * alpha);
+          dst->color.green = DIV255(src->color.green * alpha);
+          dst->color.blue  = DIV255(src->color.blue  * alpha);
+        } else {
+          dst->color.red   = 0;
+          dst->color.green = 0;
+          dst->color.blue  = 0;
+        }
+      }
+    }
+    return;
+  }
+  const int mosaic = effects->mosaic;
+  const int saturation = effects->saturation;
+  const int* m = effects->colorMatrix;
+  for (int j = 0; j < textureHeight; j++) {
+    const Pixel* srcRow = &(src[(j - j % mosaic) * texturePitch]);
+    Pixel* dstRow = &(dst[j * dstPitch]);
+    for (int i = 0; i < textureWidth; i++) {
+      const Color c = srcRow[i - i % mosaic].color;
+      const int alpha = c.alpha;
+      int red   = DIV255(c.red   * alpha);
+      int green = DIV255(c.green * alpha);
+      int blue  = DIV255(c.blue  * alpha);
+      if (effects->hasColorMatrix) {
+        const int r = red, g = green, b = blue;
+        red   = Clamp255(((m[0] * r + m[1] * g + m[2]  * b) >> 8) + m[3]);
+        green = Clamp255(((m[4] * r + m[5] * g + m[6]  * b) >> 8) + m[7]);
+        blue  = Clamp255(((m[8] * r + m[9] * g + m[10] * b) >> 8) + m[11]);
+      }
+      if (saturation < 255) {
+        // http://www.poynton.com/ColorFAQ.html
+        const int y = (6969 * red + 23434 * green + 2365 * blue) / 32768;
+        red   = ALPHA(red,   y, saturation);
+        green = ALPHA(green, y, saturation);
+        blue  = ALPHA(blue,  y, saturation);
+      }
+      Pixel* p = &(dstRow[i]);
+      p->color.red   = effects->redTable[red];
+      p->color.green = effects->greenTable[green];
+      p->color.blue  = effects->blueTable[blue];
+      p->color.alpha = 255;
+    }
+  }
+}
+
+static void
+ConvertScreenToSurface(SDL_Surface* sdlScreenBuffer, const Pixel* src,
+                       int textureWidth, int textureHeight, int texturePitch,
+                       const ScreenEffects* effects)
+{
+  SDL_LockSurface(sdlScreenBuffer);
+  ConvertScreen((Pixel*)sdlScreenBuffer->pixels,
+                sdlScreenBuffer->pitch / sdlScreenBuffer->format->BytesPerPixel,
+                src, textureWidth, textureHeight, texturePitch, effects);
+  SDL_UnlockSurface(sdlScreenBuffer);
+}
+
+/*
+ * With the direct screen, the pixels of the screen texture are uploaded
+ * as they are, and blending against the black background does what
+ * ConvertScreen does for translucent pixels
+ */
+static void
+PresentScreen(const Game* game, const Pixel* pixels, int pitch,
+              int textureWidth, int textureHeight)
+{
+  if (game->isDirectScreen) {
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, pitch);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, textureWidth, textureHeight,
+                    GL_BGRA, GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ZERO);
+  } else {
+    const SDL_Surface* sdlScreenBuffer = game->sdlScreenBuffer;
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,
+                 sdlScreenBuffer->w, sdlScreenBuffer->h,
+                 0, GL_BGRA, GL_UNSIGNED_BYTE, sdlScreenBuffer->pixels);
+  }
+  glClear(GL_COLOR_BUFFER_BIT);
+  glColor3f(1.0, 1.0, 1.0);
+  glBegin(GL_QUADS);
+  {
+    int x1, y1, x2, y2;
+    if (!game->isFullscreen) {
+      x1 = 0;
+      y1 = 0;
+      x2 = game->sdlScreen->w;
+      y2 = game->sdlScreen->h;
+    } else {
+      x1 = (game->sdlScreen->w - textureWidth)  / 2;
+      y1 = (game->sdlScreen->h - textureHeight) / 2;
+      x2 = x1 + textureWidth;
+      y2 = y1 + textureHeight;
+    }
+    const double tu = (double)textureWidth  / game->glScreenWidth;
+    const double tv = (double)textureHeight / game->glScreenHeight;
+    glTexCoord2f(0.0, 0.0);
+    glVertex3i(x1, y1, 0);
+    glTexCoord2f(tu, 0.0);
+    glVertex3i(x2, y1, 0);
+    glTexCoord2f(tu, tv);
+    glVertex3i(x2, y2, 0);
+    glTexCoord2f(0.0, tv);
+    glVertex3i(x1, y2, 0);
+  }
+  glEnd();
+  if (game->isDirectScreen) {
+    glDisable(GL_BLEND);
+  }
+
+  SDL_GL_SwapBuffers();
+}
+
+/*
+ * SDL 1.2 can't make the GL context current on another thread, so the
+ * present thread only does the per-pixel conversion and the upload and
+ * the swap stay on the main thread
+ */
+static int
+RunPresentThread(void* data)
+{
+  Game* game = (Game*)data;
+  while (true) {
+    SDL_SemWait(game->presentRequestSem);
+    if (game->isPresentThreadQuitting) {
+      break;
+    }
+    ConvertScreenToSurface(game->sdlScreenBuffer, game->presentPixels,
+                           game->presentWidth, game->presentHeight,
+                           game->presentPitch, &(game->presentEffects));
+    SDL_SemPost(game->presentDoneSem);
+  }
+  return 0;
+}
+
+static void
+WaitPresentThread(Game* game)
+{
+  if (game->isPresentPending) {
+    SDL_SemWait(game->presentDoneSem);
+    game->isPresentPending = false;
+    game->hasPresentFrame = true;
+  }
+}
+
+static void
+StartPresentThread(Game* game)
+{
+  game->presentRequestSem = SDL_CreateSemaphore(0);
+  game->presentDoneSem    = SDL_CreateSemaphore(0);
+  if (!game->presentRequestSem || !game->presentDoneSem) {
+    rb_raise_sdl_error();
+  }
+  game->isPresentThreadQuitting = false;
+  if (!(game->presentThread = SDL_CreateThread(RunPresentThread, game))) {
+    rb_raise_sdl_error();
+  }
+  game->isPresentThreaded = true;
+}
+
+static void
+StopPresentThread(Game* game)
+{
+  if (game->presentThread) {
+    WaitPresentThread(game);
+    game->isPresentThreadQuitting = true;
+    SDL_SemPost(game->presentRequestSem);
+    SDL_WaitThread(game->presentThread, NULL);
+    game->presentThread = NULL;
+  }
+  if (game->presentRequestSem) {
+    SDL_DestroySemaphore(game->presentRequestSem);
+    game->presentRequestSem = NULL;
+  }
+  if (game->presentDoneSem) {
+    SDL_DestroySemaphore(game->presentDoneSem);
+    game->presentDoneSem = NULL;
+  }
+  strb_FreeBuffer(game->presentPixels);
+  game->presentPixels = NULL;
+  game->presentPixelsSize = 0;
+  game->isPresentThreaded = false;
+  game->hasPresentFrame = false;
+}
+
+/*
+ * Returns true if the texture is the screen of the current game and is
+ * flipped on every frame by the present thread
+ */
+bool
+strb_IsFlippedScreen(VALUE rbTexture)
+{
+  volatile VALUE rbGame = rb_iv_get(rb_cGame, "current");
+  if (NIL_P(rbGame)) {
+    return false;
+  }
+  const Game* game = DATA_PTR(rbGame);
+  return game && game->isPresentThreaded && game->screen == rbTexture;
+}
+
 void
 strb_GetRealScreenSize(int* width, int* height)
 {
@@ -105,6 +424,7 @@ strb_GetWindowScale(void)
 static VALUE Game_dispose(VALUE);
 static VALUE Game_fps(VALUE);
 static VALUE Game_fps_eq(VALUE, VALUE);
+static VALUE Game_max_frame_skip_eq(VALUE, VALUE);
 static VALUE Game_screen(VALUE);
 static VALUE Game_title(VALUE);
 static VALUE Game_title_eq(VALUE, VALUE);
@@ -114,6 +434,19 @@ static VALUE Game_update_state(VALUE);
 static VALUE Game_wait(VALUE);
 static VALUE Game_window_closing(VALUE);
 
+/*
+ * True if the current frame is already late, that is, Game#wait would
+ * not sleep at all
+ */
+static bool
+IsBehind(const Game* game)
+{
+  const GameTimer* gameTimer = &(game->timer);
+  const Uint32 diff = (SDL_GetTicks() - gameTimer->before) * game->fps +
+    gameTimer->error;
+  return 1000 <= diff;
+}
+
 static VALUE
 Game_s_current(VALUE self)
 {
@@ -123,15 +456,26 @@ Game_s_current(VALUE self)
 static VALUE
 RunGame(VALUE rbGame)
 {
-  const Game* game;
-  Data_Get_Struct(rbGame, Game, game);
   while (true) {
     Game_update_state(rbGame);
     if (RTEST(Game_window_closing(rbGame))) {
       break;
     }
     rb_yield(rbGame);
-    Game_update_screen(rbGame);
+    Game* game;
+    Data_Get_Struct(rbGame, Game, game);
+    CheckDisposed(game);
+    // Logic keeps the fixed rate and the screen update is skipped instead
+    if (game->consecutiveSkips < game->maxFrameSkip && IsBehind(game)) {
+      game->consecutiveSkips++;
+      game->skippedFrames++;
+      game->isFrameSkipped = true;
+    } else {
+      Game_update_screen(rbGame);
+      game->consecutiveSkips = 0;
+      game->renderedFrames++;
+      game->isFrameSkipped = false;
+    }
     Game_wait(rbGame);
   }
   return Qnil;
@@ -164,6 +508,9 @@ Game_mark(Game* game)
   if (game && !NIL_P(game->screen)) {
     rb_gc_mark(game->screen);
   }
+  if (game && !NIL_P(game->idleTasks)) {
+    rb_gc_mark(game->idleTasks);
+  }
 }
 
 static void
@@ -171,6 +518,7 @@ Game_free(Game* game)
 {
   // should NOT to call SDL_FreeSurface
   if (game) {
+    StopPresentThread(game);
     game->sdlScreen = NULL;
     if (game->sdlScreenBuffer) {
       SDL_FreeSurface(game->sdlScreenBuffer);
@@ -188,9 +536,13 @@ Game_alloc(VALUE klass)
   game->windowScale = 1;
   game->isFullscreen = false;
   game->screen = Qnil;
+  game->idleTasks = Qnil;
   game->sdlScreen = NULL;
   game->sdlScreenBuffer = NULL;
   game->glScreen = 0;
+  game->glScreenWidth = 0;
+  game->glScreenHeight = 0;
+  game->isDirectScreen = false;
   game->realFps = 0;
   game->timer.error = 0;
   game->timer.before = SDL_GetTicks();
@@ -198,6 +550,26 @@ Game_alloc(VALUE klass)
   game->timer.counter = 0;
   game->isWindowClosing = false;
   game->isVsync = false;
+  game->maxFrameSkip = 0;
+  game->consecutiveSkips = 0;
+  game->isFrameSkipped = false;
+  game->skippedFrames = 0;
+  game->renderedFrames = 0;
+  game->isPresentThreaded = false;
+  game->presentThread = NULL;
+  game->presentRequestSem = NULL;
+  game->presentDoneSem = NULL;
+  game->isPresentThreadQuitting = false;
+  game->presentPixels = NULL;
+  game->presentPixelsSize = 0;
+  game->presentWidth = 0;
+  game->presentHeight = 0;
+  game->presentPitch = 0;
+  game->isPresentPending = false;
+  game->hasPresentFrame = false;
+  InitializeScreenEffects(&(game->screenEffects));
+  UpdateScreenEffects(&(game->screenEffects));
+  game->presentEffects = game->screenEffects;
   return Data_Wrap_Struct(klass, Game_mark, Game_free, game);;
 }
 
@@ -206,6 +578,10 @@ InitializeScreen(Game* game)
 {
   const int bpp = 32;
 
+  // The converted frame is for the old screen buffer
+  WaitPresentThread(game);
+  game->hasPresentFrame = false;
+
   VALUE rbScreen = game->screen;
   const Texture* screen;
   Data_Get_Struct(rbScreen, Texture, screen);
@@ -259,14 +635,22 @@ InitializeScreen(Game* game)
   if (!game->sdlScreen) {
     rb_raise_sdl_error();
   }
-  SDL_PixelFormat* format = game->sdlScreen->format;
-  game->sdlScreenBuffer = SDL_CreateRGBSurface(SDL_SWSURFACE,
-                                               Power2(width),
-                                               Power2(height),
-                                               bpp,
-                                               format->Bmask, format->Gmask, format->Bmask, format->Amask);
-  if (!game->sdlScreenBuffer) {
-    rb_raise_sdl_error();
+  if (game->sdlScreenBuffer) {
+    SDL_FreeSurface(game->sdlScreenBuffer);
+    game->sdlScreenBuffer = NULL;
+  }
+  game->glScreenWidth  = Power2(width);
+  game->glScreenHeight = Power2(height);
+  if (!game->isDirectScreen) {
+    SDL_PixelFormat* format = game->sdlScreen->format;
+    game->sdlScreenBuffer = SDL_CreateRGBSurface(SDL_SWSURFACE,
+                                                 game->glScreenWidth,
+                                                 game->glScreenHeight,
+                                                 bpp,
+                                                 format->Bmask, format->Gmask, format->Bmask, format->Amask);
+    if (!game->sdlScreenBuffer) {
+      rb_raise_sdl_error();
+    }
   }
 
   glClearColor(0.0, 0.0, 0.0, 0.0);
@@ -276,6 +660,12 @@ InitializeScreen(Game* game)
   glBindTexture(GL_TEXTURE_2D, game->glScreen);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  if (game->isDirectScreen) {
+    // Only the screen area is updated every frame
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+                 game->glScreenWidth, game->glScreenHeight,
+                 0, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+  }
 }
 
 static VALUE
@@ -328,6 +718,15 @@ Game_initialize(int argc, VALUE* argv, VALUE self)
   if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_vsync))) {
     game->isVsync = RTEST(val);
   }
+  if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_max_frame_skip))) {
+    Game_max_frame_skip_eq(self, val);
+  }
+  if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_direct_screen))) {
+    game->isDirectScreen = RTEST(val);
+  }
+  // The direct screen has nothing to convert on the present thread
+  const bool isPresentThreaded = !game->isDirectScreen &&
+    RTEST(rb_hash_aref(rbOptions, symbol_present_thread));
 
   SDL_ShowCursor(cursor ? SDL_ENABLE : SDL_DISABLE);
 
@@ -336,7 +735,12 @@ Game_initialize(int argc, VALUE* argv, VALUE self)
                           strb_GetTextureClass());
   game->screen = rbScreen;
 
+  game->idleTasks = rb_ary_new();
+
   InitializeScreen(game);
+  if (isPresentThreaded) {
+    StartPresentThread(game);
+  }
 
   rb_iv_set(rb_cGame, "current", self);
 
@@ -350,6 +754,10 @@ Game_dispose(VALUE self)
   Data_Get_Struct(self, Game, game);
   DATA_PTR(self) = NULL;
   if (game) {
+    StopPresentThread(game);
+    if (!NIL_P(game->idleTasks)) {
+      rb_ary_clear(game->idleTasks);
+    }
     volatile VALUE rbScreen = game->screen;
     if (!NIL_P(rbScreen)) {
       rb_funcall(rbScreen, rb_intern("dispose"), 0);
@@ -365,6 +773,24 @@ Game_dispose(VALUE self)
   return Qnil;
 }
 
+static VALUE
+Game_direct_screen(VALUE self)
+{
+  const Game* game;
+  Data_Get_Struct(self, Game, game);
+  CheckDisposed(game);
+  return game->isDirectScreen ? Qtrue : Qfalse;
+}
+
+static VALUE
+Game_cancel_idle(VALUE self, VALUE rbTask)
+{
+  const Game* game;
+  Data_Get_Struct(self, Game, game);
+  CheckDisposed(game);
+  return !NIL_P(rb_ary_delete(game->idleTasks, rbTask)) ? Qtrue : Qfalse;
+}
+
 static VALUE
 Game_disposed(VALUE self)
 {
@@ -412,6 +838,70 @@ Game_fullscreen_eq(VALUE self, VALUE rbFullscreen)
   return Qnil;
 }
 
+static VALUE
+Game_frame_skip_stats(VALUE self)
+{
+  const Game* game;
+  Data_Get_Struct(self, Game, game);
+  CheckDisposed(game);
+  volatile VALUE rbStats = rb_hash_new();
+  rb_hash_aset(rbStats, symbol_skipped,     ULONG2NUM(game->skippedFrames));
+  rb_hash_aset(rbStats, symbol_rendered,    ULONG2NUM(game->renderedFrames));
+  rb_hash_aset(rbStats, symbol_consecutive, INT2NUM(game->consecutiveSkips));
+  OBJ_FREEZE(rbStats);
+  return rbStats;
+}
+
+static VALUE
+Game_frame_skipped(VALUE self)
+{
+  const Game* game;
+  Data_Get_Struct(self, Game, game);
+  CheckDisposed(game);
+  return game->isFrameSkipped ? Qtrue : Qfalse;
+}
+
+static VALUE
+Game_idle_task_count(VALUE self)
+{
+  const Game* game;
+  Data_Get_Struct(self, Game, game);
+  CheckDisposed(game);
+  return LONG2NUM(RARRAY_LEN(game->idleTasks));
+}
+
+static VALUE
+Game_max_frame_skip(VALUE self)
+{
+  const Game* game;
+  Data_Get_Struct(self, Game, game);
+  CheckDisposed(game);
+  return INT2NUM(game->maxFrameSkip);
+}
+
+static VALUE
+Game_max_frame_skip_eq(VALUE self, VALUE rbMaxFrameSkip)
+{
+  Game* game;
+  Data_Get_Struct(self, Game, game);
+  CheckDisposed(game);
+  const int maxFrameSkip = NUM2INT(rbMaxFrameSkip);
+  if (maxFrameSkip < 0) {
+    rb_raise(rb_eArgError, "invalid max frame skip: %d", maxFrameSkip);
+  }
+  game->maxFrameSkip = MIN(maxFrameSkip, MAX_FRAME_SKIP);
+  return rbMaxFrameSkip;
+}
+
+static VALUE
+Game_present_thread(VALUE self)
+{
+  const Game* game;
+  Data_Get_Struct(self, Game, game);
+  CheckDisposed(game);
+  return game->isPresentThreaded ? Qtrue : Qfalse;
+}
+
 static VALUE
 Game_real_fps(VALUE self)
 {
@@ -421,6 +911,109 @@ Game_real_fps(VALUE self)
   return rb_float_new(game->realFps);
 }
 
+static VALUE
+Game_schedule_idle(VALUE self)
+{
+  const Game* game;
+  Data_Get_Struct(self, Game, game);
+  CheckDisposed(game);
+  rb_need_block();
+  volatile VALUE rbTask = rb_block_proc();
+  rb_ary_push(game->idleTasks, rbTask);
+  return rbTask;
+}
+
+static VALUE
+Game_screen_effects(VALUE self)
+{
+  const Game* game;
+  Data_Get_Struct(self, Game, game);
+  CheckDisposed(game);
+  const ScreenEffects* effects = &(game->screenEffects);
+  volatile VALUE rbEffects = rb_hash_new();
+  rb_hash_aset(rbEffects, symbol_brightness, INT2NUM(effects->brightness));
+  rb_hash_aset(rbEffects, symbol_tone_red,   INT2NUM(effects->toneRed));
+  rb_hash_aset(rbEffects, symbol_tone_green, INT2NUM(effects->toneGreen));
+  rb_hash_aset(rbEffects, symbol_tone_blue,  INT2NUM(effects->toneBlue));
+  rb_hash_aset(rbEffects, symbol_saturation, INT2NUM(effects->saturation));
+  rb_hash_aset(rbEffects, symbol_mosaic,     INT2NUM(effects->mosaic));
+  volatile VALUE rbMatrix = Qnil;
+  if (effects->hasColorMatrix) {
+    rbMatrix = rb_ary_new2(12);
+    for (int i = 0; i < 12; i++) {
+      const double value = (i % 4 == 3) ?
+        effects->colorMatrix[i] : effects->colorMatrix[i] / 256.0;
+      rb_ary_push(rbMatrix, rb_float_new(value));
+    }
+    OBJ_FREEZE(rbMatrix);
+  }
+  rb_hash_aset(rbEffects, symbol_color_matrix, rbMatrix);
+  OBJ_FREEZE(rbEffects);
+  return rbEffects;
+}
+
+static int
+GetEffectValue(VALUE rbEffects, VALUE key, int defaultValue, int min, int max)
+{
+  volatile VALUE val = rb_hash_aref(rbEffects, key);
+  if (NIL_P(val)) {
+    return defaultValue;
+  }
+  const int value = NUM2INT(val);
+  if (value < min || max < value) {
+    volatile VALUE rbKeyStr = rb_inspect(key);
+    rb_raise(rb_eArgError, "invalid %s: %d", StringValueCStr(rbKeyStr), value);
+  }
+  return value;
+}
+
+/*
+ * Sets the effects applied when the screen is presented. Omitted keys
+ * are reset to their defaults, and nil clears all the effects.
+ */
+static VALUE
+Game_screen_effects_eq(VALUE self, VALUE rbEffects)
+{
+  Game* game;
+  Data_Get_Struct(self, Game, game);
+  CheckDisposed(game);
+  ScreenEffects effects;
+  InitializeScreenEffects(&effects);
+  if (!NIL_P(rbEffects)) {
+    Check_Type(rbEffects, T_HASH);
+    effects.brightness =
+      GetEffectValue(rbEffects, symbol_brightness, 255, 0, 255);
+    effects.toneRed =
+      GetEffectValue(rbEffects, symbol_tone_red, 0, -255, 255);
+    effects.toneGreen =
+      GetEffectValue(rbEffects, symbol_tone_green, 0, -255, 255);
+    effects.toneBlue =
+      GetEffectValue(rbEffects, symbol_tone_blue, 0, -255, 255);
+    effects.saturation =
+      GetEffectValue(rbEffects, symbol_saturation, 255, 0, 255);
+    effects.mosaic =
+      GetEffectValue(rbEffects, symbol_mosaic, 1, 1, 255);
+    volatile VALUE rbMatrix = rb_hash_aref(rbEffects, symbol_color_matrix);
+    if (!NIL_P(rbMatrix)) {
+      Check_Type(rbMatrix, T_ARRAY);
+      if (RARRAY_LEN(rbMatrix) != 12) {
+        rb_raise(rb_eArgError, "color matrix size should be 12, %ld given",
+                 RARRAY_LEN(rbMatrix));
+      }
+      // Rows of (red, green, blue, offset)
+      for (int i = 0; i < 12; i++) {
+        const double value = NUM2DBL(RARRAY_PTR(rbMatrix)[i]);
+        effects.colorMatrix[i] =
+          (int)((i % 4 == 3) ? value : value * 256);
+      }
+      effects.hasColorMatrix = true;
+    }
+  }
+  UpdateScreenEffects(&effects);
+  game->screenEffects = effects;
+  return rbEffects;
+}
+
 static VALUE
 Game_screen(VALUE self)
 {
@@ -455,75 +1048,66 @@ Game_title_eq(VALUE self, VALUE rbTitle)
 static VALUE
 Game_update_screen(VALUE self)
 {
-  const Game* game;
+  Game* game;
   Data_Get_Struct(self, Game, game);
   CheckDisposed(game);
 
   volatile VALUE rbScreen = game->screen;
-  const Texture* texture;
+  Texture* texture;
   Data_Get_Struct(rbScreen, Texture, texture);
   strb_CheckDisposedTexture(texture);
-  const Pixel* src = texture->pixels;
-  SDL_Surface* sdlScreenBuffer = game->sdlScreenBuffer;
-  SDL_LockSurface(sdlScreenBuffer);
-  Pixel* dst = (Pixel*)sdlScreenBuffer->pixels;
-  const int screenPadding =
-    sdlScreenBuffer->pitch / sdlScreenBuffer->format->BytesPerPixel - sdlScreenBuffer->w;
-  const int textureWidth  = texture->width;
-  const int textureHeight = texture->height;
-  const int heightPadding = sdlScreenBuffer->w - texture->width + screenPadding;
-  for (int j = 0; j < textureHeight; j++, dst += heightPadding) {
-    for (int i = 0; i < textureWidth; i++, src++, dst++) {
-      const uint8_t alpha = src->color.alpha;
-      if (alpha == 255) {
-        *dst = *src;
-      } else if (alpha) {
-        dst->color.red   = DIV255(src->color.red   * alpha);
-        dst->color.green = DIV255(src->color.green * alpha);
-        dst->color.blue  = DIV255(src->color.blue  * alpha);
-      } else {
-        dst->color.red   = 0;
-        dst->color.green = 0;
-        dst->color.blue  = 0;
-      }
-    }
-  }
-
-  SDL_UnlockSurface(sdlScreenBuffer);
-
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,
-               sdlScreenBuffer->w, sdlScreenBuffer->h,
-               0, GL_BGRA, GL_UNSIGNED_BYTE, sdlScreenBuffer->pixels);
-  glClear(GL_COLOR_BUFFER_BIT);
-  glColor3f(1.0, 1.0, 1.0);
-  glBegin(GL_QUADS);
-  {
-    int x1, y1, x2, y2;
-    if (!game->isFullscreen) {
-      x1 = 0;
-      y1 = 0;
-      x2 = game->sdlScreen->w;
-      y2 = game->sdlScreen->h;
+  const ScreenEffects* effects = &(game->screenEffects);
+  if (!game->isPresentThreaded) {
+    if (!game->isDirectScreen) {
+      ConvertScreenToSurface(game->sdlScreenBuffer, texture->pixels,
+                             texture->width, texture->height, texture->pitch,
+                             effects);
+      PresentScreen(game, NULL, 0, texture->width, texture->height);
+    } else if (effects->isEnabled) {
+      // Effects need a pass over the pixels even with the direct screen
+      const ScratchMark scratchMark = strb_GetScratchMark();
+      Pixel* pixels =
+        strb_AllocScratch(sizeof(Pixel) * texture->pitch * texture->height);
+      ConvertScreen(pixels, texture->pitch, texture->pixels,
+                    texture->width, texture->height, texture->pitch,
+                    effects);
+      PresentScreen(game, pixels, texture->pitch,
+                    texture->width, texture->height);
+      strb_ReleaseScratch(scratchMark);
     } else {
-      x1 = (game->sdlScreen->w - textureWidth)  / 2;
-      y1 = (game->sdlScreen->h - textureHeight) / 2;
-      x2 = x1 + textureWidth;
-      y2 = y1 + textureHeight;
+      PresentScreen(game, texture->pixels, texture->pitch,
+                    texture->width, texture->height);
     }
-    const double tu = (double)textureWidth  / sdlScreenBuffer->w;
-    const double tv = (double)textureHeight / sdlScreenBuffer->h;
-    glTexCoord2f(0.0, 0.0);
-    glVertex3i(x1, y1, 0);
-    glTexCoord2f(tu, 0.0);
-    glVertex3i(x2, y1, 0);
-    glTexCoord2f(tu, tv);
-    glVertex3i(x2, y2, 0);
-    glTexCoord2f(0.0, tv);
-    glVertex3i(x1, y2, 0);
+    return Qnil;
   }
-  glEnd();
 
-  SDL_GL_SwapBuffers();
+  /*
+   * The previous frame is presented while this frame is converted on
+   * the present thread, which delays the screen by one frame. The screen
+   * is flipped with the buffer of the frame before, so its contents are
+   * not kept across frames and it can't have views.
+   */
+  WaitPresentThread(game);
+  if (game->hasPresentFrame) {
+    PresentScreen(game, NULL, 0, game->presentWidth, game->presentHeight);
+    game->hasPresentFrame = false;
+  }
+  const size_t size = sizeof(Pixel) * texture->pitch * texture->height;
+  if (game->presentPixelsSize != size) {
+    strb_FreeBuffer(game->presentPixels);
+    game->presentPixels = strb_AllocBuffer(size);
+    game->presentPixelsSize = size;
+    MEMZERO(game->presentPixels, Pixel, texture->pitch * texture->height);
+  }
+  Pixel* const pixels = game->presentPixels;
+  game->presentPixels = texture->pixels;
+  texture->pixels = pixels;
+  game->presentWidth  = texture->width;
+  game->presentHeight = texture->height;
+  game->presentPitch  = texture->pitch;
+  game->presentEffects = *effects;
+  game->isPresentPending = true;
+  SDL_SemPost(game->presentRequestSem);
   return Qnil;
 }
 
@@ -533,12 +1117,36 @@ Game_update_state(VALUE self)
   Game* game;
   Data_Get_Struct(self, Game, game);
   CheckDisposed(game);
-  SDL_Event event;
-  game->isWindowClosing = (SDL_PollEvent(&event) && event.type == SDL_QUIT);
-  strb_UpdateInput();
+  strb_UpdateAudio();
+  game->isWindowClosing = strb_UpdateInput();
+  strb_ResetScratch();
   return Qnil;
 }
 
+/*
+ * Runs the first idle task with the milliseconds left in the frame, and
+ * moves it to the end of the queue unless it returns false or nil.
+ * Returns false if there is no time or no task to run.
+ */
+static bool
+RunIdleTask(VALUE self, Uint32 remaining)
+{
+  const Game* game = DATA_PTR(self);
+  volatile VALUE rbTasks = game->idleTasks;
+  if (remaining <= IDLE_MARGIN || RARRAY_LEN(rbTasks) == 0) {
+    return false;
+  }
+  volatile VALUE rbTask = rb_ary_shift(rbTasks);
+  volatile VALUE rbResult =
+    rb_funcall(rbTask, rb_intern("call"), 1,
+               UINT2NUM(remaining - IDLE_MARGIN));
+  // The task may have disposed the game
+  if (RTEST(rbResult) && DATA_PTR(self)) {
+    rb_ary_push(rbTasks, rbTask);
+  }
+  return true;
+}
+
 static VALUE
 Game_wait(VALUE self)
 {
@@ -551,12 +1159,21 @@ Game_wait(VALUE self)
   while (true) {
     now = SDL_GetTicks();
     Uint32 diff = (now - gameTimer->before) * fps + gameTimer->error;
+    if (diff < 1000 && fps && RunIdleTask(self, (1000 - diff) / fps)) {
+      if (!DATA_PTR(self)) {
+        return Qnil;
+      }
+      continue;
+    }
     if (1000 <= diff) {
-      gameTimer->error = MIN(diff - 1000, 1000);
+      // Delays up to the skippable frames are caught up later
+      const Uint32 maxError = 1000 * (Uint32)(game->maxFrameSkip + 1);
+      gameTimer->error = MIN(diff - 1000, maxError);
       gameTimer->before = now;
       break;
-    }        
+    }
     SDL_Delay(1);
+    strb_PollEvents();
   }
   gameTimer->counter++;
   if (1000 <= now - gameTimer->before2) {
@@ -608,14 +1225,25 @@ strb_InitializeGame(VALUE _rb_mStarRuby)
   rb_define_singleton_method(rb_cGame, "ticks",     Game_s_ticks,     0);
   rb_define_alloc_func(rb_cGame, Game_alloc);
   rb_define_private_method(rb_cGame, "initialize", Game_initialize, -1);
+  rb_define_method(rb_cGame, "direct_screen?",  Game_direct_screen,   0);
+  rb_define_method(rb_cGame, "cancel_idle",     Game_cancel_idle,     1);
   rb_define_method(rb_cGame, "dispose",         Game_dispose,         0);
   rb_define_method(rb_cGame, "disposed?",       Game_disposed,        0);
   rb_define_method(rb_cGame, "fps",             Game_fps,             0);
   rb_define_method(rb_cGame, "fps=",            Game_fps_eq,          1);
+  rb_define_method(rb_cGame, "frame_skip_stats", Game_frame_skip_stats, 0);
+  rb_define_method(rb_cGame, "frame_skipped?",  Game_frame_skipped,   0);
   rb_define_method(rb_cGame, "fullscreen?",     Game_fullscreen,      0);
   rb_define_method(rb_cGame, "fullscreen=",     Game_fullscreen_eq,   1);
+  rb_define_method(rb_cGame, "idle_task_count", Game_idle_task_count, 0);
+  rb_define_method(rb_cGame, "max_frame_skip",  Game_max_frame_skip,  0);
+  rb_define_method(rb_cGame, "max_frame_skip=", Game_max_frame_skip_eq, 1);
+  rb_define_method(rb_cGame, "present_thread?", Game_present_thread,  0);
   rb_define_method(rb_cGame, "real_fps",        Game_real_fps,        0);
+  rb_define_method(rb_cGame, "schedule_idle",   Game_schedule_idle,   0);
   rb_define_method(rb_cGame, "screen",          Game_screen,          0);
+  rb_define_method(rb_cGame, "screen_effects",  Game_screen_effects,  0);
+  rb_define_method(rb_cGame, "screen_effects=", Game_screen_effects_eq, 1);
   rb_define_method(rb_cGame, "title",           Game_title,           0);
   rb_define_method(rb_cGame, "title=",          Game_title_eq,        1);
   rb_define_method(rb_cGame, "update_screen",   Game_update_screen,   0);
@@ -625,12 +1253,25 @@ strb_InitializeGame(VALUE _rb_mStarRuby)
   rb_define_method(rb_cGame, "window_scale",    Game_window_scale,    0);
   rb_define_method(rb_cGame, "window_scale=",   Game_window_scale_eq, 1);
 
-  symbol_cursor       = ID2SYM(rb_intern("cursor"));
-  symbol_fps          = ID2SYM(rb_intern("fps"));
-  symbol_fullscreen   = ID2SYM(rb_intern("fullscreen"));
-  symbol_title        = ID2SYM(rb_intern("title"));
-  symbol_vsync        = ID2SYM(rb_intern("vsync"));
-  symbol_window_scale = ID2SYM(rb_intern("window_scale"));
+  symbol_brightness     = ID2SYM(rb_intern("brightness"));
+  symbol_color_matrix   = ID2SYM(rb_intern("color_matrix"));
+  symbol_consecutive    = ID2SYM(rb_intern("consecutive"));
+  symbol_cursor         = ID2SYM(rb_intern("cursor"));
+  symbol_direct_screen  = ID2SYM(rb_intern("direct_screen"));
+  symbol_fps            = ID2SYM(rb_intern("fps"));
+  symbol_fullscreen     = ID2SYM(rb_intern("fullscreen"));
+  symbol_max_frame_skip = ID2SYM(rb_intern("max_frame_skip"));
+  symbol_mosaic         = ID2SYM(rb_intern("mosaic"));
+  symbol_present_thread = ID2SYM(rb_intern("present_thread"));
+  symbol_rendered       = ID2SYM(rb_intern("rendered"));
+  symbol_saturation     = ID2SYM(rb_intern("saturation"));
+  symbol_skipped        = ID2SYM(rb_intern("skipped"));
+  symbol_title          = ID2SYM(rb_intern("title"));
+  symbol_tone_blue      = ID2SYM(rb_intern("tone_blue"));
+  symbol_tone_green     = ID2SYM(rb_intern("tone_green"));
+  symbol_tone_red       = ID2SYM(rb_intern("tone_red"));
+  symbol_vsync          = ID2SYM(rb_intern("vsync"));
+  symbol_window_scale   = ID2SYM(rb_intern("window_scale"));
 
   return rb_cGame;
 }
@@ -1,17 +1,28 @@
 #include "starruby_private.h"
 
-typedef struct KeyboardKey {
+#define MAX_EVENT_COUNT (1024)
+#define MAX_KEY_COUNT (128)
+#define AXIS_THRESHOLD (3200)
+
+typedef struct {
   VALUE rbSymbol;
   SDLKey sdlKey;
   int state;
-  struct KeyboardKey* next;
+  bool isTapped;
 } KeyboardKey;
 static KeyboardKey* keyboardKeys;
+static int keyboardKeyCount;
+// Indexes of keyboardKeys by SDLKey (-1 for unsupported keys)
+static int keyIndexes[SDLK_LAST];
+// Symbol => index of keyboardKeys
+static volatile VALUE rbKeyIndexes = Qnil;
 
 static int gamepadCount;
 
 typedef struct {
   SDL_Joystick* sdlJoystick;
+  int xDirection;
+  int yDirection;
   int downState;
   int leftState;
   int rightState;
@@ -25,9 +36,79 @@ typedef struct {
   int leftState;
   int middleState;
   int rightState;
+  Uint8 tappedButtons;
 } Mouse;
 static Mouse* mouse;
 
+typedef enum {
+  DEVICE_KEYBOARD,
+  DEVICE_GAMEPAD,
+  DEVICE_MOUSE,
+} Device;
+
+/*
+ * SDL 1.2 events carry no timestamp, so an event is stamped when it is
+ * dequeued. Game#wait polls every millisecond while it sleeps, which
+ * keeps the stamps within about a millisecond of the real input.
+ */
+typedef struct {
+  Uint32 ticks;
+  Device device;
+  int deviceNumber;
+  bool isPressed;
+  VALUE rbKey;
+} InputEvent;
+
+typedef struct {
+  InputEvent items[MAX_EVENT_COUNT];
+  int count;
+} InputEventList;
+// Events of the current frame and events polled for the next one
+static InputEventList* frameEvents;
+static InputEventList* pendingEvents;
+static bool isQuitRequested = false;
+
+/*
+ * Results of Input.keys are kept until the next frame since games tend
+ * to ask the same question many times per frame
+ */
+typedef struct {
+  Device device;
+  int deviceNumber;
+  int duration;
+  int delay;
+  int interval;
+} KeysQuery;
+#define MAX_KEYS_QUERY_COUNT (16)
+static KeysQuery keysQueries[MAX_KEYS_QUERY_COUNT];
+static int keysQueryCount = 0;
+static volatile VALUE rbKeysResults = Qnil;
+
+/*
+ * The raw input of a frame is packed into inputFrame so that it can be
+ * recorded and replayed:
+ *
+ *   keys:     a bit per keyboard key
+ *   mouse:    x and y (16-bit little endian) and the SDL button mask
+ *   gamepads: a byte of directions (down, left, right, up) and a bit
+ *             per button, for each gamepad
+ *
+ * A record file starts with RECORD_MAGIC, the key count, the gamepad
+ * count and the button count of each gamepad. Then each frame is a
+ * byte of 1 followed by the packed input, or a byte of 0 when the input
+ * is the same as the previous frame.
+ */
+#define RECORD_MAGIC "SRIN\x01"
+static uint8_t* inputFrame = NULL;
+static uint8_t* lastInputFrame = NULL;
+static size_t inputFrameSize = 0;
+static FILE* recordFile = NULL;
+static bool isFirstRecordedFrame = false;
+static FILE* replayFile = NULL;
+// The gamepads while replaying are the recorded ones
+static Gamepad* liveGamepads = NULL;
+static int liveGamepadCount = 0;
+
 static volatile VALUE rb_mInput = Qundef;
 
 static volatile VALUE symbol_delay         = Qundef;
@@ -40,6 +121,8 @@ static volatile VALUE symbol_keyboard      = Qundef;
 static volatile VALUE symbol_left          = Qundef;
 static volatile VALUE symbol_middle        = Qundef;
 static volatile VALUE symbol_mouse         = Qundef;
+static volatile VALUE symbol_press         = Qundef;
+static volatile VALUE symbol_release       = Qundef;
 static volatile VALUE symbol_right         = Qundef;
 static volatile VALUE symbol_up            = Qundef;
 
@@ -111,200 +194,661 @@ IsPressed(const int status, const int duration, const int delay, const int inter
   return false;
 }
 
-static VALUE
-Input_keys(int argc, VALUE* argv, VALUE self)
+static Device
+GetDevice(VALUE rbDevice)
 {
-  volatile VALUE rbDevice, rbOptions;
-  rb_scan_args(argc, argv, "11", &rbDevice, &rbOptions);
   Check_Type(rbDevice, T_SYMBOL);
-  if (NIL_P(rbOptions)) {
-    rbOptions = rb_hash_new();
+  if (rbDevice == symbol_keyboard) {
+    return DEVICE_KEYBOARD;
+  } else if (rbDevice == symbol_gamepad) {
+    return DEVICE_GAMEPAD;
+  } else if (rbDevice == symbol_mouse) {
+    return DEVICE_MOUSE;
   }
-  volatile VALUE rbResult = rb_ary_new();
-
-  int deviceNumber = 0;
-  int duration     = -1;
-  int delay        = -1;
-  int interval     = 0;
+  volatile VALUE rbDeviceInspect =
+    rb_funcall(rbDevice, rb_intern("inspect"), 0);
+  rb_raise(rb_eArgError, "invalid device: %s", StringValueCStr(rbDeviceInspect));
+}
 
-  volatile VALUE val;
+static void
+GetKeysQuery(KeysQuery* query, VALUE rbDevice, VALUE rbOptions)
+{
+  query->device       = GetDevice(rbDevice);
+  query->deviceNumber = 0;
+  query->duration     = -1;
+  query->delay        = -1;
+  query->interval     = 0;
+  if (NIL_P(rbOptions)) {
+    return;
+  }
   Check_Type(rbOptions, T_HASH);
+  volatile VALUE val;
   if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_device_number))) {
-    deviceNumber = NUM2INT(val);
+    query->deviceNumber = NUM2INT(val);
   }
   if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_duration))) {
-    duration = NUM2INT(val);
+    query->duration = NUM2INT(val);
   }
   if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_delay))) {
-    delay = NUM2INT(val);
+    query->delay = NUM2INT(val);
   }
   if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_interval))) {
-    interval = NUM2INT(val);
+    query->interval = NUM2INT(val);
   }
-  if (rbDevice == symbol_keyboard) {
-    KeyboardKey* key = keyboardKeys;
-    while (key) {
-      if (IsPressed(key->state, duration, delay, interval)) {
+}
+
+inline static bool
+IsQueryPressed(const KeysQuery* query, int state)
+{
+  return IsPressed(state, query->duration, query->delay, query->interval);
+}
+
+static Gamepad*
+GetGamepad(const KeysQuery* query)
+{
+  if (0 <= query->deviceNumber && query->deviceNumber < gamepadCount) {
+    return &(gamepads[query->deviceNumber]);
+  }
+  return NULL;
+}
+
+static VALUE
+Input_keys(int argc, VALUE* argv, VALUE self)
+{
+  volatile VALUE rbDevice, rbOptions;
+  rb_scan_args(argc, argv, "11", &rbDevice, &rbOptions);
+  KeysQuery query;
+  GetKeysQuery(&query, rbDevice, rbOptions);
+  for (int i = 0; i < keysQueryCount; i++) {
+    if (!memcmp(&(keysQueries[i]), &query, sizeof(KeysQuery))) {
+      return RARRAY_PTR(rbKeysResults)[i];
+    }
+  }
+
+  volatile VALUE rbResult = rb_ary_new();
+  if (query.device == DEVICE_KEYBOARD) {
+    for (int i = 0; i < keyboardKeyCount; i++) {
+      const KeyboardKey* key = &(keyboardKeys[i]);
+      if (IsQueryPressed(&query, key->state)) {
         rb_ary_push(rbResult, key->rbSymbol);
       }
-      key = key->next;
     }
-  } else if (rbDevice == symbol_gamepad) {
-    if (0 <= deviceNumber && deviceNumber < gamepadCount) {
-      Gamepad* gamepad = &(gamepads[deviceNumber]);
-      if (IsPressed(gamepad->downState, duration, delay, interval)) {
+  } else if (query.device == DEVICE_GAMEPAD) {
+    const Gamepad* gamepad = GetGamepad(&query);
+    if (gamepad) {
+      if (IsQueryPressed(&query, gamepad->downState)) {
         rb_ary_push(rbResult, symbol_down);
       }
-      if (IsPressed(gamepad->leftState, duration, delay, interval)) {
+      if (IsQueryPressed(&query, gamepad->leftState)) {
         rb_ary_push(rbResult, symbol_left);
       }
-      if (IsPressed(gamepad->rightState, duration, delay, interval)) {
+      if (IsQueryPressed(&query, gamepad->rightState)) {
         rb_ary_push(rbResult, symbol_right);
       }
-      if (IsPressed(gamepad->upState, duration, delay, interval)) {
+      if (IsQueryPressed(&query, gamepad->upState)) {
         rb_ary_push(rbResult, symbol_up);
       }
       for (int i = 0; i < gamepad->buttonCount; i++) {
-        if (IsPressed(gamepad->buttonStates[i], duration, delay, interval)) {
+        if (IsQueryPressed(&query, gamepad->buttonStates[i])) {
           rb_ary_push(rbResult, INT2FIX(i + 1));
         }
       }
     }
-  } else if (rbDevice == symbol_mouse) {
-    if (IsPressed(mouse->leftState, duration, delay, interval)) {
+  } else if (query.device == DEVICE_MOUSE) {
+    if (IsQueryPressed(&query, mouse->leftState)) {
       rb_ary_push(rbResult, symbol_left);
     }
-    if (IsPressed(mouse->middleState, duration, delay, interval)) {
+    if (IsQueryPressed(&query, mouse->middleState)) {
       rb_ary_push(rbResult, symbol_middle);
     }
-    if (IsPressed(mouse->rightState, duration, delay, interval)) {
+    if (IsQueryPressed(&query, mouse->rightState)) {
       rb_ary_push(rbResult, symbol_right);
     }
-  } else {
-    volatile VALUE rbDeviceInspect =
-      rb_funcall(rbDevice, rb_intern("inspect"), 0);
-    rb_raise(rb_eArgError, "invalid device: %s", StringValueCStr(rbDeviceInspect));
   }
+  OBJ_FREEZE(rbResult);
 
+  if (keysQueryCount < MAX_KEYS_QUERY_COUNT) {
+    keysQueries[keysQueryCount++] = query;
+    rb_ary_push(rbKeysResults, rbResult);
+  }
+  return rbResult;
+}
+
+static VALUE
+Input_pressed(int argc, VALUE* argv, VALUE self)
+{
+  volatile VALUE rbDevice, rbKey, rbOptions;
+  rb_scan_args(argc, argv, "21", &rbDevice, &rbKey, &rbOptions);
+  KeysQuery query;
+  GetKeysQuery(&query, rbDevice, rbOptions);
+  int state = 0;
+  if (query.device == DEVICE_KEYBOARD) {
+    volatile VALUE rbIndex = rb_hash_lookup(rbKeyIndexes, rbKey);
+    if (!NIL_P(rbIndex)) {
+      state = keyboardKeys[FIX2INT(rbIndex)].state;
+    }
+  } else if (query.device == DEVICE_GAMEPAD) {
+    const Gamepad* gamepad = GetGamepad(&query);
+    if (gamepad) {
+      if (FIXNUM_P(rbKey)) {
+        const int button = FIX2INT(rbKey);
+        if (1 <= button && button <= gamepad->buttonCount) {
+          state = gamepad->buttonStates[button - 1];
+        }
+      } else if (rbKey == symbol_down) {
+        state = gamepad->downState;
+      } else if (rbKey == symbol_left) {
+        state = gamepad->leftState;
+      } else if (rbKey == symbol_right) {
+        state = gamepad->rightState;
+      } else if (rbKey == symbol_up) {
+        state = gamepad->upState;
+      }
+    }
+  } else if (query.device == DEVICE_MOUSE) {
+    if (rbKey == symbol_left) {
+      state = mouse->leftState;
+    } else if (rbKey == symbol_middle) {
+      state = mouse->middleState;
+    } else if (rbKey == symbol_right) {
+      state = mouse->rightState;
+    }
+  }
+  return IsQueryPressed(&query, state) ? Qtrue : Qfalse;
+}
+
+static VALUE
+Input_events(int argc, VALUE* argv, VALUE self)
+{
+  volatile VALUE rbDevice, rbOptions;
+  rb_scan_args(argc, argv, "11", &rbDevice, &rbOptions);
+  const Device device = GetDevice(rbDevice);
+  int deviceNumber = 0;
+  if (!NIL_P(rbOptions)) {
+    Check_Type(rbOptions, T_HASH);
+    volatile VALUE val;
+    if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_device_number))) {
+      deviceNumber = NUM2INT(val);
+    }
+  }
+  volatile VALUE rbResult = rb_ary_new();
+  for (int i = 0; i < frameEvents->count; i++) {
+    const InputEvent* event = &(frameEvents->items[i]);
+    if (event->device != device ||
+        (device == DEVICE_GAMEPAD && event->deviceNumber != deviceNumber)) {
+      continue;
+    }
+    volatile VALUE rbEvent =
+      rb_ary_new3(3, event->rbKey,
+                  event->isPressed ? symbol_press : symbol_release,
+                  UINT2NUM(event->ticks));
+    OBJ_FREEZE(rbEvent);
+    rb_ary_push(rbResult, rbEvent);
+  }
   OBJ_FREEZE(rbResult);
   return rbResult;
 }
 
-#define ADD_KEY(currentKey, _name, _sdlKey)   \
-  do {                                        \
-    KeyboardKey* key = ALLOC(KeyboardKey);    \
-    key->rbSymbol = ID2SYM(rb_intern(_name)); \
-    key->sdlKey   = _sdlKey;                  \
-    key->state    = 0;                        \
-    key->next     = NULL;                     \
-    currentKey->next = key;                   \
-    currentKey = key;                         \
-  } while (false)
+static void
+AddEvent(Device device, int deviceNumber, VALUE rbKey, bool isPressed)
+{
+  if (MAX_EVENT_COUNT <= pendingEvents->count) {
+    return;
+  }
+  InputEvent* event = &(pendingEvents->items[pendingEvents->count++]);
+  event->ticks        = SDL_GetTicks();
+  event->device       = device;
+  event->deviceNumber = deviceNumber;
+  event->isPressed    = isPressed;
+  event->rbKey        = rbKey;
+}
 
-void
-strb_UpdateInput(void)
+static void
+AddAxisEvents(int deviceNumber, int* direction, Sint16 value,
+              VALUE rbNegative, VALUE rbPositive)
 {
-  SDL_PumpEvents();
-  SDL_JoystickUpdate();
+  const int newDirection =
+    (value < -AXIS_THRESHOLD) ? -1 : (AXIS_THRESHOLD < value) ? 1 : 0;
+  if (newDirection == *direction) {
+    return;
+  }
+  if (*direction) {
+    AddEvent(DEVICE_GAMEPAD, deviceNumber,
+             (*direction < 0) ? rbNegative : rbPositive, false);
+  }
+  if (newDirection) {
+    AddEvent(DEVICE_GAMEPAD, deviceNumber,
+             (newDirection < 0) ? rbNegative : rbPositive, true);
+  }
+  *direction = newDirection;
+}
 
-  const Uint8* sdlKeyState = SDL_GetKeyState(NULL);
-  KeyboardKey* key = keyboardKeys;
-  while (key) {
-    if (sdlKeyState[key->sdlKey]) {
-      key->state++;
-    } else {
-      key->state = 0;
-    }
-    key = key->next;
+static VALUE
+GetMouseButtonSymbol(Uint8 button)
+{
+  switch (button) {
+  case SDL_BUTTON_LEFT:
+    return symbol_left;
+  case SDL_BUTTON_MIDDLE:
+    return symbol_middle;
+  case SDL_BUTTON_RIGHT:
+    return symbol_right;
+  default:
+    return Qnil;
   }
+}
+
+inline static int
+GetKeyBytes(void)
+{
+  return (keyboardKeyCount + 7) / 8;
+}
 
+static size_t
+GetInputFrameSize(void)
+{
+  size_t size = GetKeyBytes() + 5;
   for (int i = 0; i < gamepadCount; i++) {
-    Gamepad* gamepad = &(gamepads[i]);
-    if (SDL_JoystickGetAxis(gamepad->sdlJoystick, 1) > 3200) {
-      gamepad->downState++;
-    } else {
-      gamepad->downState = 0;
-    }
-    if (SDL_JoystickGetAxis(gamepad->sdlJoystick, 0) < -3200) {
-      gamepad->leftState++;
-    } else {
-      gamepad->leftState = 0;
-    }
-    if (SDL_JoystickGetAxis(gamepad->sdlJoystick, 0) > 3200) {
-      gamepad->rightState++;
-    } else {
-      gamepad->rightState = 0;
-    }
-    if (SDL_JoystickGetAxis(gamepad->sdlJoystick, 1) < -3200) {
-      gamepad->upState++;
-    } else {
-      gamepad->upState = 0;
-    }
-    for (int j = 0; j < gamepad->buttonCount; j++) {
-      if (SDL_JoystickGetButton(gamepad->sdlJoystick, j) == SDL_PRESSED) {
-        gamepad->buttonStates[j]++;
-      } else {
-        gamepad->buttonStates[j] = 0;
-      }
-    }
+    size += 1 + (gamepads[i].buttonCount + 7) / 8;
+  }
+  return size;
+}
+
+static void
+ResizeInputFrame(void)
+{
+  inputFrameSize = GetInputFrameSize();
+  REALLOC_N(inputFrame, uint8_t, inputFrameSize);
+  REALLOC_N(lastInputFrame, uint8_t, inputFrameSize);
+  MEMZERO(inputFrame, uint8_t, inputFrameSize);
+  MEMZERO(lastInputFrame, uint8_t, inputFrameSize);
+}
+
+inline static void
+SetBit(uint8_t* bits, int index, bool value)
+{
+  if (value) {
+    bits[index / 8] |= 1 << (index % 8);
+  }
+}
+
+inline static bool
+GetBit(const uint8_t* bits, int index)
+{
+  return bits[index / 8] & (1 << (index % 8));
+}
+
+inline static int
+UpdateState(int state, bool isPressed)
+{
+  return isPressed ? state + 1 : 0;
+}
+
+static void
+SampleInput(uint8_t* frame)
+{
+  MEMZERO(frame, uint8_t, inputFrameSize);
+  // A key pressed and released within a frame still counts as pressed
+  const Uint8* sdlKeyState = SDL_GetKeyState(NULL);
+  for (int i = 0; i < keyboardKeyCount; i++) {
+    KeyboardKey* key = &(keyboardKeys[i]);
+    SetBit(frame, i, sdlKeyState[key->sdlKey] || key->isTapped);
+    key->isTapped = false;
   }
+  frame += GetKeyBytes();
 
   const int windowScale = strb_GetWindowScale();
   int mouseLocationX, mouseLocationY;
   const Uint8 sdlMouseButtons =
-    SDL_GetMouseState(&mouseLocationX, &mouseLocationY);
+    SDL_GetMouseState(&mouseLocationX, &mouseLocationY) |
+    mouse->tappedButtons;
+  mouse->tappedButtons = 0;
   int screenWidth = 0, screenHeight = 0;
   strb_GetScreenSize(&screenWidth, &screenHeight);
   int realScreenWidth = 0, realScreenHeight = 0;
   strb_GetRealScreenSize(&realScreenWidth, &realScreenHeight);
   mouseLocationX -= (realScreenWidth  - screenWidth  * windowScale) / 2;
   mouseLocationY -= (realScreenHeight - screenHeight * windowScale) / 2;
-  volatile VALUE rbMouseLocation =
-    rb_assoc_new(INT2NUM(mouseLocationX / windowScale),
-                 INT2NUM(mouseLocationY / windowScale));
+  const int16_t x = mouseLocationX / windowScale;
+  const int16_t y = mouseLocationY / windowScale;
+  frame[0] = (uint16_t)x & 0xff;
+  frame[1] = (uint16_t)x >> 8;
+  frame[2] = (uint16_t)y & 0xff;
+  frame[3] = (uint16_t)y >> 8;
+  frame[4] = sdlMouseButtons;
+  frame += 5;
+
+  for (int i = 0; i < gamepadCount; i++) {
+    const Gamepad* gamepad = &(gamepads[i]);
+    SDL_Joystick* sdlJoystick = gamepad->sdlJoystick;
+    SetBit(frame, 0, SDL_JoystickGetAxis(sdlJoystick, 1) > AXIS_THRESHOLD);
+    SetBit(frame, 1, SDL_JoystickGetAxis(sdlJoystick, 0) < -AXIS_THRESHOLD);
+    SetBit(frame, 2, SDL_JoystickGetAxis(sdlJoystick, 0) > AXIS_THRESHOLD);
+    SetBit(frame, 3, SDL_JoystickGetAxis(sdlJoystick, 1) < -AXIS_THRESHOLD);
+    frame++;
+    for (int j = 0; j < gamepad->buttonCount; j++) {
+      SetBit(frame, j,
+             SDL_JoystickGetButton(sdlJoystick, j) == SDL_PRESSED);
+    }
+    frame += (gamepad->buttonCount + 7) / 8;
+  }
+}
+
+static void
+ApplyInput(const uint8_t* frame)
+{
+  for (int i = 0; i < keyboardKeyCount; i++) {
+    KeyboardKey* key = &(keyboardKeys[i]);
+    key->state = UpdateState(key->state, GetBit(frame, i));
+  }
+  frame += GetKeyBytes();
+
+  const int16_t x = (int16_t)(frame[0] | (frame[1] << 8));
+  const int16_t y = (int16_t)(frame[2] | (frame[3] << 8));
+  volatile VALUE rbMouseLocation = rb_assoc_new(INT2NUM(x), INT2NUM(y));
   OBJ_FREEZE(rbMouseLocation);
   rb_iv_set(rb_mInput, "mouse_location", rbMouseLocation);
+  const Uint8 mouseButtons = frame[4];
+  mouse->leftState = UpdateState(mouse->leftState,
+                                 mouseButtons & SDL_BUTTON(SDL_BUTTON_LEFT));
+  mouse->middleState = UpdateState(mouse->middleState,
+                                   mouseButtons & SDL_BUTTON(SDL_BUTTON_MIDDLE));
+  mouse->rightState = UpdateState(mouse->rightState,
+                                  mouseButtons & SDL_BUTTON(SDL_BUTTON_RIGHT));
+  frame += 5;
+
+  for (int i = 0; i < gamepadCount; i++) {
+    Gamepad* gamepad = &(gamepads[i]);
+    gamepad->downState  = UpdateState(gamepad->downState,  GetBit(frame, 0));
+    gamepad->leftState  = UpdateState(gamepad->leftState,  GetBit(frame, 1));
+    gamepad->rightState = UpdateState(gamepad->rightState, GetBit(frame, 2));
+    gamepad->upState    = UpdateState(gamepad->upState,    GetBit(frame, 3));
+    frame++;
+    for (int j = 0; j < gamepad->buttonCount; j++) {
+      gamepad->buttonStates[j] =
+        UpdateState(gamepad->buttonStates[j], GetBit(frame, j));
+    }
+    frame += (gamepad->buttonCount + 7) / 8;
+  }
+}
+
+static void
+WriteInputFrame(void)
+{
+  if (!isFirstRecordedFrame &&
+      !memcmp(inputFrame, lastInputFrame, inputFrameSize)) {
+    fputc(0, recordFile);
+    return;
+  }
+  fputc(1, recordFile);
+  fwrite(inputFrame, 1, inputFrameSize, recordFile);
+  MEMCPY(lastInputFrame, inputFrame, uint8_t, inputFrameSize);
+  isFirstRecordedFrame = false;
+}
+
+static bool
+ReadInputFrame(void)
+{
+  const int tag = fgetc(replayFile);
+  if (tag == 0) {
+    return true;
+  }
+  return tag == 1 &&
+    fread(inputFrame, 1, inputFrameSize, replayFile) == inputFrameSize;
+}
+
+static void
+StopRecording(void)
+{
+  if (recordFile) {
+    fclose(recordFile);
+    recordFile = NULL;
+  }
+}
 
-  if (sdlMouseButtons & SDL_BUTTON(SDL_BUTTON_LEFT)) {
-    mouse->leftState++;
-  } else {
-    mouse->leftState = 0;
+static void
+FreeGamepads(Gamepad* pads, int count)
+{
+  for (int i = 0; i < count; i++) {
+    free(pads[i].buttonStates);
   }
-  if (sdlMouseButtons & SDL_BUTTON(SDL_BUTTON_MIDDLE)) {
-    mouse->middleState++;
-  } else {
-    mouse->middleState = 0;
+  free(pads);
+}
+
+static void
+StopReplay(void)
+{
+  if (!replayFile) {
+    return;
+  }
+  fclose(replayFile);
+  replayFile = NULL;
+  FreeGamepads(gamepads, gamepadCount);
+  gamepads     = liveGamepads;
+  gamepadCount = liveGamepadCount;
+  liveGamepads = NULL;
+  liveGamepadCount = 0;
+  ResizeInputFrame();
+}
+
+static VALUE
+Input_record(VALUE self, VALUE rbPath)
+{
+  const char* path = StringValueCStr(rbPath);
+  StopRecording();
+  StopReplay();
+  FILE* fp = fopen(path, "wb");
+  if (!fp) {
+    rb_raise(rb_path2class("Errno::ENOENT"), "%s", path);
   }
-  if (sdlMouseButtons & SDL_BUTTON(SDL_BUTTON_RIGHT)) {
-    mouse->rightState++;
-  } else {
-    mouse->rightState = 0;
+  fwrite(RECORD_MAGIC, 1, sizeof(RECORD_MAGIC) - 1, fp);
+  fputc(keyboardKeyCount, fp);
+  fputc(gamepadCount, fp);
+  for (int i = 0; i < gamepadCount; i++) {
+    fputc(MIN(gamepads[i].buttonCount, 255), fp);
   }
+  recordFile = fp;
+  isFirstRecordedFrame = true;
+  return Qnil;
+}
+
+static VALUE
+Input_recording(VALUE self)
+{
+  return recordFile ? Qtrue : Qfalse;
+}
+
+static VALUE
+Input_replay(VALUE self, VALUE rbPath)
+{
+  const char* path = StringValueCStr(rbPath);
+  StopRecording();
+  StopReplay();
+  FILE* fp = fopen(path, "rb");
+  if (!fp) {
+    rb_raise(rb_path2class("Errno::ENOENT"), "%s", path);
+  }
+  char magic[sizeof(RECORD_MAGIC) - 1];
+  const int keyCount =
+    (fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+     !memcmp(magic, RECORD_MAGIC, sizeof(magic))) ? fgetc(fp) : EOF;
+  const int padCount = (keyCount == keyboardKeyCount) ? fgetc(fp) : EOF;
+  if (padCount == EOF) {
+    fclose(fp);
+    rb_raise(rb_eArgError, "invalid input record: %s", path);
+  }
+  Gamepad* pads = ALLOC_N(Gamepad, padCount);
+  MEMZERO(pads, Gamepad, padCount);
+  for (int i = 0; i < padCount; i++) {
+    const int buttonCount = fgetc(fp);
+    pads[i].buttonCount  = MAX(buttonCount, 0);
+    pads[i].buttonStates = ALLOC_N(int, pads[i].buttonCount);
+    MEMZERO(pads[i].buttonStates, int, pads[i].buttonCount);
+  }
+  liveGamepads     = gamepads;
+  liveGamepadCount = gamepadCount;
+  gamepads     = pads;
+  gamepadCount = padCount;
+  replayFile = fp;
+  ResizeInputFrame();
+  return Qnil;
+}
+
+static VALUE
+Input_replaying(VALUE self)
+{
+  return replayFile ? Qtrue : Qfalse;
+}
+
+static VALUE
+Input_stop_recording(VALUE self)
+{
+  StopRecording();
+  return Qnil;
+}
+
+static VALUE
+Input_stop_replay(VALUE self)
+{
+  StopReplay();
+  return Qnil;
+}
+
+/*
+ * Drains the whole SDL event queue so that motion events never pile up
+ * in front of SDL_QUIT. Returns true if the window is requested to
+ * close in this frame.
+ */
+bool
+strb_PollEvents(void)
+{
+  SDL_Event event;
+  while (SDL_PollEvent(&event)) {
+    switch (event.type) {
+    case SDL_QUIT:
+      isQuitRequested = true;
+      break;
+    }
+    if (replayFile) {
+      continue;
+    }
+    switch (event.type) {
+    case SDL_KEYDOWN:
+    case SDL_KEYUP:
+      if (0 <= event.key.keysym.sym && event.key.keysym.sym < SDLK_LAST &&
+          0 <= keyIndexes[event.key.keysym.sym]) {
+        KeyboardKey* key = &(keyboardKeys[keyIndexes[event.key.keysym.sym]]);
+        const bool isPressed = (event.type == SDL_KEYDOWN);
+        key->isTapped |= isPressed;
+        AddEvent(DEVICE_KEYBOARD, 0, key->rbSymbol, isPressed);
+      }
+      break;
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+      {
+        volatile VALUE rbButton = GetMouseButtonSymbol(event.button.button);
+        if (!NIL_P(rbButton)) {
+          const bool isPressed = (event.type == SDL_MOUSEBUTTONDOWN);
+          if (isPressed) {
+            mouse->tappedButtons |= SDL_BUTTON(event.button.button);
+          }
+          AddEvent(DEVICE_MOUSE, 0, rbButton, isPressed);
+        }
+      }
+      break;
+    case SDL_JOYBUTTONDOWN:
+    case SDL_JOYBUTTONUP:
+      AddEvent(DEVICE_GAMEPAD, event.jbutton.which,
+               INT2FIX(event.jbutton.button + 1),
+               event.type == SDL_JOYBUTTONDOWN);
+      break;
+    case SDL_JOYAXISMOTION:
+      if (event.jaxis.which < gamepadCount) {
+        Gamepad* gamepad = &(gamepads[event.jaxis.which]);
+        if (event.jaxis.axis == 0) {
+          AddAxisEvents(event.jaxis.which, &(gamepad->xDirection),
+                        event.jaxis.value, symbol_left, symbol_right);
+        } else if (event.jaxis.axis == 1) {
+          AddAxisEvents(event.jaxis.which, &(gamepad->yDirection),
+                        event.jaxis.value, symbol_up, symbol_down);
+        }
+      }
+      break;
+    }
+  }
+  return isQuitRequested;
+}
+
+#define ADD_KEY(_name, _sdlKey)                                 \
+  do {                                                          \
+    KeyboardKey* key = &(keyboardKeys[keyboardKeyCount]);       \
+    key->rbSymbol = ID2SYM(rb_intern(_name));                   \
+    key->sdlKey   = _sdlKey;                                    \
+    key->state    = 0;                                          \
+    key->isTapped = false;                                      \
+    keyIndexes[_sdlKey] = keyboardKeyCount;                     \
+    rb_hash_aset(rbKeyIndexes, key->rbSymbol,                   \
+                 INT2FIX(keyboardKeyCount));                    \
+    keyboardKeyCount++;                                         \
+  } while (false)
+
+/*
+ * Drains the remaining events and starts a new input frame. Returns true
+ * if the window was requested to close since the last call.
+ */
+bool
+strb_UpdateInput(void)
+{
+  const bool isWindowClosing = strb_PollEvents();
+  isQuitRequested = false;
+  SDL_JoystickUpdate();
+
+  InputEventList* events = frameEvents;
+  frameEvents = pendingEvents;
+  pendingEvents = events;
+  pendingEvents->count = 0;
+  keysQueryCount = 0;
+  rb_ary_clear(rbKeysResults);
+
+  if (replayFile && !ReadInputFrame()) {
+    StopReplay();
+  }
+  if (!replayFile) {
+    SampleInput(inputFrame);
+  }
+  if (recordFile) {
+    WriteInputFrame();
+  }
+  ApplyInput(inputFrame);
+  return isWindowClosing;
 }
 
 void
 strb_InitializeSdlInput()
 {
-  keyboardKeys = ALLOC(KeyboardKey);
-  keyboardKeys->rbSymbol = Qundef;
-  keyboardKeys->sdlKey   = 0;
-  keyboardKeys->state    = 0;
-  keyboardKeys->next     = NULL;
-  
-  KeyboardKey* currentKey = keyboardKeys;
+  rb_gc_register_address((VALUE*)&rbKeyIndexes);
+  rbKeyIndexes = rb_hash_new();
+  rb_gc_register_address((VALUE*)&rbKeysResults);
+  rbKeysResults = rb_ary_new();
+
+  keyboardKeys = ALLOC_N(KeyboardKey, MAX_KEY_COUNT);
+  keyboardKeyCount = 0;
+  for (int i = 0; i < SDLK_LAST; i++) {
+    keyIndexes[i] = -1;
+  }
   for (int i = 0; i < SDLK_z - SDLK_a + 1; i++) {
-    ADD_KEY(currentKey, ((char[]){'a' + i, '\0'}), SDLK_a + i);
+    ADD_KEY(((char[]){'a' + i, '\0'}), SDLK_a + i);
   }
   for (int i = 0; i <= 9; i++) {
-    ADD_KEY(currentKey, ((char[]){'d', '0' + i, '\0'}), SDLK_0 + i);
+    ADD_KEY(((char[]){'d', '0' + i, '\0'}), SDLK_0 + i);
   }
   for (int i = 0; i < 15; i++) {
     char name[4];
     snprintf(name, sizeof(name), "f%d", i + 1);
-    ADD_KEY(currentKey, name, SDLK_F1 + i);
+    ADD_KEY(name, SDLK_F1 + i);
   }
   for (int i = 0; i <= 9; i++) {
-    ADD_KEY(currentKey, ((char[]){'n','u','m','p','a','d', '0' + i, '\0'}),
+    ADD_KEY(((char[]){'n','u','m','p','a','d', '0' + i, '\0'}),
             SDLK_KP0 + i);
   }
   char* names[] = {
@@ -352,7 +896,7 @@ strb_InitializeSdlInput()
   for (sdlKey = sdlKeys, name = names;
        *name;
        name++, sdlKey++) {
-    ADD_KEY(currentKey, *name, *sdlKey);
+    ADD_KEY(*name, *sdlKey);
   }
   SDL_JoystickEventState(SDL_ENABLE);
   gamepadCount = SDL_NumJoysticks();
@@ -370,12 +914,21 @@ strb_InitializeSdlInput()
 
   mouse = ALLOC(Mouse);
   MEMZERO(mouse, Mouse, 1);
+
+  ResizeInputFrame();
+
+  frameEvents = ALLOC(InputEventList);
+  frameEvents->count = 0;
+  pendingEvents = ALLOC(InputEventList);
+  pendingEvents->count = 0;
 }
 
 VALUE
 strb_InitializeInput(VALUE rb_mStarRuby)
 {
   rb_mInput = rb_define_module_under(rb_mStarRuby, "Input");
+  rb_define_module_function(rb_mInput, "events",
+                            Input_events, -1);
   rb_define_module_function(rb_mInput, "gamepad_count",
                             Input_gamepad_count, 0);
   rb_define_module_function(rb_mInput, "mouse_location",
@@ -383,6 +936,20 @@ strb_InitializeInput(VALUE rb_mStarRuby)
   rb_define_module_function(rb_mInput, "mouse_location=",
                             Input_mouse_location_eq, 1);
   rb_define_module_function(rb_mInput, "keys",   Input_keys, -1);
+  rb_define_module_function(rb_mInput, "pressed?",
+                            Input_pressed, -1);
+  rb_define_module_function(rb_mInput, "record",
+                            Input_record, 1);
+  rb_define_module_function(rb_mInput, "recording?",
+                            Input_recording, 0);
+  rb_define_module_function(rb_mInput, "replay",
+                            Input_replay, 1);
+  rb_define_module_function(rb_mInput, "replaying?",
+                            Input_replaying, 0);
+  rb_define_module_function(rb_mInput, "stop_recording",
+                            Input_stop_recording, 0);
+  rb_define_module_function(rb_mInput, "stop_replay",
+                            Input_stop_replay, 0);
 
   symbol_delay         = ID2SYM(rb_intern("delay"));
   symbol_device_number = ID2SYM(rb_intern("device_number"));
@@ -394,6 +961,8 @@ strb_InitializeInput(VALUE rb_mStarRuby)
   symbol_left          = ID2SYM(rb_intern("left"));
   symbol_middle        = ID2SYM(rb_intern("middle"));
   symbol_mouse         = ID2SYM(rb_intern("mouse"));
+  symbol_press         = ID2SYM(rb_intern("press"));
+  symbol_release       = ID2SYM(rb_intern("release"));
   symbol_right         = ID2SYM(rb_intern("right"));
   symbol_up            = ID2SYM(rb_intern("up"));
 
@@ -407,9 +976,21 @@ strb_InitializeInput(VALUE rb_mStarRuby)
 void
 strb_FinalizeInput(void)
 {
+  StopRecording();
+  StopReplay();
+  free(inputFrame);
+  inputFrame = NULL;
+  free(lastInputFrame);
+  lastInputFrame = NULL;
+
   free(mouse);
   mouse = NULL;
 
+  free(frameEvents);
+  frameEvents = NULL;
+  free(pendingEvents);
+  pendingEvents = NULL;
+
   for (int i = 0; i < gamepadCount; i++) {
     Gamepad* gamepad = &(gamepads[i]);
     if (SDL_JoystickOpened(i)) {
@@ -422,28 +1003,18 @@ strb_FinalizeInput(void)
   free(gamepads);
   gamepads = NULL;
   
-  KeyboardKey* key = keyboardKeys;
-  while (key) {
-    KeyboardKey* nextKey = key->next;
-    free(key);
-    key = nextKey;
-  }
+  free(keyboardKeys);
   keyboardKeys = NULL;
+  keyboardKeyCount = 0;
 }
 
 #ifdef DEBUG
 static KeyboardKey*
 searchKey(const char* name)
 {
-  volatile VALUE rbNameSymbol = ID2SYM(rb_intern(name));
-  KeyboardKey* key = keyboardKeys;
-  while (key) {
-    if (key->rbSymbol == rbNameSymbol) {
-      return key;
-    }
-    key = key->next;
-  }
-  return NULL;
+  volatile VALUE rbIndex =
+    rb_hash_lookup(rbKeyIndexes, ID2SYM(rb_intern(name)));
+  return NIL_P(rbIndex) ? NULL : &(keyboardKeys[FIX2INT(rbIndex)]);
 }
 
 void
@@ -484,9 +1055,10 @@ strb_TestInput(void)
   assert(SDLK_RIGHT == searchKey("right")->sdlKey);
   assert(SDLK_UP    == searchKey("up")->sdlKey);
 
-  for (KeyboardKey* key = keyboardKeys; key; key = key->next) {
-    assert(0 == key->state);
+  for (int i = 0; i < keyboardKeyCount; i++) {
+    assert(0 == keyboardKeys[i].state);
   }
+  assert(keyboardKeyCount <= MAX_KEY_COUNT);
 
   assert(false == IsPressed(0, -1, -1, 0));
   assert(true  == IsPressed(1, -1, -1, 0));
@@ -0,0 +1,318 @@
+#include "starruby_private.h"
+
+#define MIN_CLASS_SIZE     (1024)
+#define CLASS_COUNT        (80)
+#define SCRATCH_CHUNK_SIZE (1024 * 1024)
+
+static volatile VALUE symbol_hits           = Qundef;
+static volatile VALUE symbol_misses         = Qundef;
+static volatile VALUE symbol_pooled_buffers = Qundef;
+static volatile VALUE symbol_pooled_bytes   = Qundef;
+static volatile VALUE symbol_scratch_bytes  = Qundef;
+static volatile VALUE symbol_scratch_peak   = Qundef;
+
+typedef struct {
+  void* raw;
+  size_t size;
+  int sizeClass;
+} BufferHeader;
+
+typedef struct {
+  void* head;
+  int count;
+} FreeList;
+
+typedef struct ScratchChunk {
+  struct ScratchChunk* next;
+  size_t size;
+  size_t offset;
+  uint8_t* data;
+} ScratchChunk;
+
+static FreeList freeLists[CLASS_COUNT];
+static size_t poolLimit = 32 * 1024 * 1024;
+static size_t pooledBytes = 0;
+static int pooledBuffers = 0;
+static unsigned long hitCount = 0;
+static unsigned long missCount = 0;
+
+static ScratchChunk* scratchTop = NULL;
+static ScratchChunk* scratchSpare = NULL;
+static size_t scratchBytes = 0;
+static size_t scratchUsed = 0;
+static size_t scratchPeak = 0;
+
+inline static size_t
+AlignSize(size_t size)
+{
+  return (size + BUFFER_ALIGNMENT - 1) & ~(size_t)(BUFFER_ALIGNMENT - 1);
+}
+
+inline static BufferHeader*
+GetBufferHeader(void* buffer)
+{
+  return (BufferHeader*)((uint8_t*)buffer - sizeof(BufferHeader));
+}
+
+static int
+GetSizeClass(size_t size, size_t* classSize)
+{
+  /*
+   * 1024, 1280, 1536, 1792, 2048, 2560, 3072, 3584, 4096, ...
+   * (four classes per doubling)
+   */
+  size_t unit = MIN_CLASS_SIZE / 4;
+  size_t s = MIN_CLASS_SIZE;
+  int index = 0;
+  while (s < size) {
+    s += unit;
+    index++;
+    if (index % 4 == 0) {
+      unit <<= 1;
+    }
+    if (CLASS_COUNT <= index) {
+      *classSize = size;
+      return -1;
+    }
+  }
+  *classSize = s;
+  return index;
+}
+
+static void*
+AllocAlignedBuffer(size_t size, int sizeClass)
+{
+  uint8_t* raw =
+    ALLOC_N(uint8_t, size + BUFFER_ALIGNMENT + sizeof(BufferHeader));
+  uintptr_t aligned = (uintptr_t)(raw + sizeof(BufferHeader));
+  aligned = AlignSize(aligned);
+  BufferHeader* header = GetBufferHeader((void*)aligned);
+  header->raw       = raw;
+  header->size      = size;
+  header->sizeClass = sizeClass;
+  return (void*)aligned;
+}
+
+void*
+strb_AllocBuffer(size_t size)
+{
+  size_t classSize;
+  const int sizeClass = GetSizeClass(size, &classSize);
+  if (0 <= sizeClass) {
+    FreeList* freeList = &(freeLists[sizeClass]);
+    if (freeList->head) {
+      void* buffer = freeList->head;
+      freeList->head = *(void**)buffer;
+      freeList->count--;
+      pooledBytes -= classSize;
+      pooledBuffers--;
+      hitCount++;
+      return buffer;
+    }
+  }
+  missCount++;
+  return AllocAlignedBuffer(classSize, sizeClass);
+}
+
+void
+strb_FreeBuffer(void* buffer)
+{
+  if (!buffer) {
+    return;
+  }
+  BufferHeader* header = GetBufferHeader(buffer);
+  const int sizeClass = header->sizeClass;
+  if (0 <= sizeClass && pooledBytes + header->size <= poolLimit) {
+    FreeList* freeList = &(freeLists[sizeClass]);
+    *(void**)buffer = freeList->head;
+    freeList->head = buffer;
+    freeList->count++;
+    pooledBytes += header->size;
+    pooledBuffers++;
+    return;
+  }
+  xfree(header->raw);
+}
+
+static size_t
+TrimBufferPool(size_t limit)
+{
+  size_t freedBytes = 0;
+  // Larger buffers go first
+  for (int i = CLASS_COUNT - 1; 0 <= i && limit < pooledBytes; i--) {
+    FreeList* freeList = &(freeLists[i]);
+    while (freeList->head && limit < pooledBytes) {
+      void* buffer = freeList->head;
+      BufferHeader* header = GetBufferHeader(buffer);
+      freeList->head = *(void**)buffer;
+      freeList->count--;
+      pooledBytes -= header->size;
+      pooledBuffers--;
+      freedBytes += header->size;
+      xfree(header->raw);
+    }
+  }
+  return freedBytes;
+}
+
+static size_t
+TrimScratch(void)
+{
+  size_t freedBytes = 0;
+  while (scratchSpare) {
+    ScratchChunk* chunk = scratchSpare;
+    scratchSpare = chunk->next;
+    scratchBytes -= chunk->size;
+    freedBytes += chunk->size;
+    xfree(chunk);
+  }
+  return freedBytes;
+}
+
+void*
+strb_AllocScratch(size_t size)
+{
+  size = AlignSize(size);
+  if (!scratchTop || scratchTop->size < scratchTop->offset + size) {
+    ScratchChunk* chunk = NULL;
+    ScratchChunk* prev = NULL;
+    for (ScratchChunk* c = scratchSpare; c; prev = c, c = c->next) {
+      if (size <= c->size) {
+        chunk = c;
+        if (prev) {
+          prev->next = c->next;
+        } else {
+          scratchSpare = c->next;
+        }
+        break;
+      }
+    }
+    if (!chunk) {
+      const size_t chunkSize = MAX(size, SCRATCH_CHUNK_SIZE);
+      chunk = (ScratchChunk*)ALLOC_N(uint8_t, sizeof(ScratchChunk) +
+                                     chunkSize + BUFFER_ALIGNMENT);
+      chunk->size = chunkSize;
+      chunk->data = (uint8_t*)AlignSize((uintptr_t)(chunk + 1));
+      scratchBytes += chunkSize;
+    }
+    chunk->offset = 0;
+    chunk->next = scratchTop;
+    scratchTop = chunk;
+  }
+  void* p = scratchTop->data + scratchTop->offset;
+  scratchTop->offset += size;
+  scratchUsed += size;
+  if (scratchPeak < scratchUsed) {
+    scratchPeak = scratchUsed;
+  }
+  return p;
+}
+
+ScratchMark
+strb_GetScratchMark(void)
+{
+  return (ScratchMark){
+    .chunk  = scratchTop,
+    .offset = scratchTop ? scratchTop->offset : 0,
+    .used   = scratchUsed,
+  };
+}
+
+void
+strb_ReleaseScratch(ScratchMark mark)
+{
+  while (scratchTop && scratchTop != mark.chunk) {
+    ScratchChunk* chunk = scratchTop;
+    scratchTop = chunk->next;
+    chunk->next = scratchSpare;
+    scratchSpare = chunk;
+  }
+  if (scratchTop) {
+    scratchTop->offset = mark.offset;
+  }
+  scratchUsed = mark.used;
+}
+
+void
+strb_ResetScratch(void)
+{
+  strb_ReleaseScratch((ScratchMark){.chunk = NULL, .offset = 0, .used = 0});
+}
+
+static VALUE
+StarRuby_buffer_pool_limit(VALUE self)
+{
+  return ULONG2NUM(poolLimit);
+}
+
+static VALUE
+StarRuby_buffer_pool_limit_eq(VALUE self, VALUE rbLimit)
+{
+  const long limit = NUM2LONG(rbLimit);
+  if (limit < 0) {
+    rb_raise(rb_eArgError, "invalid buffer pool limit: %ld", limit);
+  }
+  poolLimit = limit;
+  TrimBufferPool(poolLimit);
+  return rbLimit;
+}
+
+static VALUE
+StarRuby_buffer_pool_stats(VALUE self)
+{
+  volatile VALUE rbStats = rb_hash_new();
+  rb_hash_aset(rbStats, symbol_pooled_bytes,   ULONG2NUM(pooledBytes));
+  rb_hash_aset(rbStats, symbol_pooled_buffers, INT2NUM(pooledBuffers));
+  rb_hash_aset(rbStats, symbol_hits,           ULONG2NUM(hitCount));
+  rb_hash_aset(rbStats, symbol_misses,         ULONG2NUM(missCount));
+  rb_hash_aset(rbStats, symbol_scratch_bytes,  ULONG2NUM(scratchBytes));
+  rb_hash_aset(rbStats, symbol_scratch_peak,   ULONG2NUM(scratchPeak));
+  OBJ_FREEZE(rbStats);
+  return rbStats;
+}
+
+static VALUE
+StarRuby_trim_buffer_pool(int argc, VALUE* argv, VALUE self)
+{
+  volatile VALUE rbLimit;
+  rb_scan_args(argc, argv, "01", &rbLimit);
+  long limit = 0;
+  if (!NIL_P(rbLimit)) {
+    limit = NUM2LONG(rbLimit);
+    if (limit < 0) {
+      rb_raise(rb_eArgError, "invalid buffer pool limit: %ld", limit);
+    }
+  }
+  size_t freedBytes = TrimBufferPool(limit);
+  freedBytes += TrimScratch();
+  scratchPeak = scratchUsed;
+  return ULONG2NUM(freedBytes);
+}
+
+void
+strb_InitializePool(VALUE rb_mStarRuby)
+{
+  rb_define_module_function(rb_mStarRuby, "buffer_pool_limit",
+                            StarRuby_buffer_pool_limit, 0);
+  rb_define_module_function(rb_mStarRuby, "buffer_pool_limit=",
+                            StarRuby_buffer_pool_limit_eq, 1);
+  rb_define_module_function(rb_mStarRuby, "buffer_pool_stats",
+                            StarRuby_buffer_pool_stats, 0);
+  rb_define_module_function(rb_mStarRuby, "trim_buffer_pool",
+                            StarRuby_trim_buffer_pool, -1);
+
+  symbol_hits           = ID2SYM(rb_intern("hits"));
+  symbol_misses         = ID2SYM(rb_intern("misses"));
+  symbol_pooled_buffers = ID2SYM(rb_intern("pooled_buffers"));
+  symbol_pooled_bytes   = ID2SYM(rb_intern("pooled_bytes"));
+  symbol_scratch_bytes  = ID2SYM(rb_intern("scratch_bytes"));
+  symbol_scratch_peak   = ID2SYM(rb_intern("scratch_peak"));
+}
+
+void
+strb_FinalizePool(void)
+{
+  TrimBufferPool(0);
+  strb_ResetScratch();
+  TrimScratch();
+}
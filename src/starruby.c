@@ -1,42 +1,181 @@
 #include "starruby_private.h"
+#ifdef HAVE_RUBY_ST_H
+# include "ruby/util.h"
+#else
+# include "util.h"
+#endif
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
 
 static volatile VALUE rb_eStarRubyError = Qundef;
 
+/*
+ * Resolved paths are cached by the requested path (prefixed with the
+ * current directory if relative):
+ *   a String: the resolved path
+ *   false:    no file (cached only while the directory is watched)
+ * Without inotify, StarRuby.clear_path_cache must be called after asset
+ * files are added, renamed or removed.
+ */
+static VALUE rbCompletePathCache = Qundef;
+static unsigned long pathCacheHits = 0;
+static unsigned long pathCacheMisses = 0;
+static unsigned long pathCacheInvalidations = 0;
+#ifdef HAVE_SYS_INOTIFY_H
+static int inotifyFd = -1;
+#endif
+
+static volatile VALUE symbol_entries       = Qundef;
+static volatile VALUE symbol_hits          = Qundef;
+static volatile VALUE symbol_invalidations = Qundef;
+static volatile VALUE symbol_misses        = Qundef;
+static volatile VALUE symbol_watching      = Qundef;
+
+static VALUE
+GetCompletePathCacheKey(VALUE rbPath)
+{
+  const char* path = RSTRING_PTR(rbPath);
+  if (path[0] == '/' || path[0] == '\\' ||
+      (path[0] && path[1] == ':')) {
+    return rbPath;
+  }
+  char* cwd = ruby_getcwd();
+  volatile VALUE rbKey = rb_str_new2(cwd);
+  xfree(cwd);
+  rb_str_cat2(rbKey, "/");
+  return rb_str_concat(rbKey, rbPath);
+}
+
+/*
+ * Drops all entries when anything was created, removed or renamed in a
+ * watched directory
+ */
+static void
+PollPathCacheWatches(void)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+  if (inotifyFd < 0) {
+    return;
+  }
+  char buffer[4096];
+  bool isChanged = false;
+  while (0 < read(inotifyFd, buffer, sizeof(buffer))) {
+    isChanged = true;
+  }
+  if (isChanged) {
+    rb_hash_clear(rbCompletePathCache);
+    pathCacheInvalidations++;
+  }
+#endif
+}
+
+static bool
+WatchPathDirectory(VALUE rbPath)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+  if (inotifyFd < 0) {
+    return false;
+  }
+  volatile VALUE rbDirPath =
+    rb_funcall(rb_cFile, rb_intern("dirname"), 1, rbPath);
+  return 0 <= inotify_add_watch(inotifyFd, StringValueCStr(rbDirPath),
+                                IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+#else
+  return false;
+#endif
+}
+
+static VALUE
+SearchCompletePath(VALUE rbPath)
+{
+  if (RTEST(rb_funcall(rb_mFileTest, rb_intern("file?"), 1, rbPath))) {
+    return rbPath;
+  }
+  const char* path = StringValueCStr(rbPath);
+  volatile VALUE rbPathes =
+    rb_funcall(rb_cDir, rb_intern("[]"), 1,
+               rb_str_cat2(rb_str_dup(rbPath), ".*"));
+  volatile VALUE rbFileName =
+    rb_funcall(rb_cFile, rb_intern("basename"), 1, rbPath);
+  for (int i = 0; i < RARRAY_LEN(rbPathes); i++) {
+    volatile VALUE rbFileNameWithoutExt =
+      rb_funcall(rb_cFile, rb_intern("basename"), 2,
+                 RARRAY_PTR(rbPathes)[i], rb_str_new2(".*"));
+    if (rb_str_cmp(rbFileName, rbFileNameWithoutExt) != 0) {
+      RARRAY_PTR(rbPathes)[i] = Qnil;
+    }
+  }
+  rb_funcall(rbPathes, rb_intern("compact!"), 0);
+  switch (RARRAY_LEN(rbPathes)) {
+  case 0:
+    return Qnil;
+  case 1:
+    return RARRAY_PTR(rbPathes)[0];
+  default:
+    rb_raise(rb_eArgError, "ambiguous path: %s", path);
+    return Qnil;
+  }
+}
+
 VALUE
 strb_GetCompletePath(VALUE rbPath, bool raiseNotFoundError)
 {
   const char* path = StringValueCStr(rbPath);
-  if (!RTEST(rb_funcall(rb_mFileTest, rb_intern("file?"), 1, rbPath))) {
-    volatile VALUE rbPathes =
-      rb_funcall(rb_cDir, rb_intern("[]"), 1,
-                 rb_str_cat2(rb_str_dup(rbPath), ".*"));
-    volatile VALUE rbFileName =
-      rb_funcall(rb_cFile, rb_intern("basename"), 1, rbPath);
-    for (int i = 0; i < RARRAY_LEN(rbPathes); i++) {
-      volatile VALUE rbFileNameWithoutExt =
-        rb_funcall(rb_cFile, rb_intern("basename"), 2,
-                   RARRAY_PTR(rbPathes)[i], rb_str_new2(".*"));
-      if (rb_str_cmp(rbFileName, rbFileNameWithoutExt) != 0) {
-        RARRAY_PTR(rbPathes)[i] = Qnil;
-      }
+  PollPathCacheWatches();
+  volatile VALUE rbKey = GetCompletePathCacheKey(rbPath);
+  volatile VALUE rbCompletePath = rb_hash_lookup2(rbCompletePathCache,
+                                                  rbKey, Qundef);
+  if (rbCompletePath != Qundef) {
+    pathCacheHits++;
+  } else {
+    pathCacheMisses++;
+    rbCompletePath = SearchCompletePath(rbPath);
+    const bool isWatched = WatchPathDirectory(rbPath);
+    if (!NIL_P(rbCompletePath)) {
+      rbCompletePath = rb_str_new_frozen(rbCompletePath);
+      rb_hash_aset(rbCompletePathCache, rbKey, rbCompletePath);
+    } else if (isWatched) {
+      rb_hash_aset(rbCompletePathCache, rbKey, Qfalse);
     }
-    rb_funcall(rbPathes, rb_intern("compact!"), 0);
-    switch (RARRAY_LEN(rbPathes)) {
-    case 0:
-      if (raiseNotFoundError) {
-        rb_raise(rb_path2class("Errno::ENOENT"), "%s", path);
-      }
-      break;
-    case 1:
-      return RARRAY_PTR(rbPathes)[0];
-    default:
-      rb_raise(rb_eArgError, "ambiguous path: %s", path);
-      break;
+  }
+  if (!RTEST(rbCompletePath)) {
+    if (raiseNotFoundError) {
+      rb_raise(rb_path2class("Errno::ENOENT"), "%s", path);
     }
     return Qnil;
-  } else {
-    return rbPath;
   }
+  return rbCompletePath;
+}
+
+static VALUE
+StarRuby_clear_path_cache(VALUE self)
+{
+  const long size = RHASH_SIZE(rbCompletePathCache);
+  rb_hash_clear(rbCompletePathCache);
+  return LONG2NUM(size);
+}
+
+static VALUE
+StarRuby_path_cache_stats(VALUE self)
+{
+  PollPathCacheWatches();
+  volatile VALUE rbStats = rb_hash_new();
+  rb_hash_aset(rbStats, symbol_entries,
+               LONG2NUM(RHASH_SIZE(rbCompletePathCache)));
+  rb_hash_aset(rbStats, symbol_hits,          ULONG2NUM(pathCacheHits));
+  rb_hash_aset(rbStats, symbol_misses,        ULONG2NUM(pathCacheMisses));
+  rb_hash_aset(rbStats, symbol_invalidations,
+               ULONG2NUM(pathCacheInvalidations));
+#ifdef HAVE_SYS_INOTIFY_H
+  rb_hash_aset(rbStats, symbol_watching, 0 <= inotifyFd ? Qtrue : Qfalse);
+#else
+  rb_hash_aset(rbStats, symbol_watching, Qfalse);
+#endif
+  OBJ_FREEZE(rbStats);
+  return rbStats;
 }
 
 static void
@@ -45,6 +184,13 @@ FinalizeStarRuby(VALUE unused)
   TTF_Quit();
   strb_FinalizeAudio();
   strb_FinalizeInput();
+  strb_FinalizePool();
+#ifdef HAVE_SYS_INOTIFY_H
+  if (0 <= inotifyFd) {
+    close(inotifyFd);
+    inotifyFd = -1;
+  }
+#endif
   SDL_Quit();
 }
 
@@ -82,10 +228,28 @@ Init_starruby(void)
   strb_InitializeFont(rb_mStarRuby);
   strb_InitializeGame(rb_mStarRuby);
   strb_InitializeInput(rb_mStarRuby);
+  strb_InitializePool(rb_mStarRuby);
   strb_InitializeTexture(rb_mStarRuby);
 
   rb_set_end_proc(FinalizeStarRuby, Qnil);
 
+  rb_define_module_function(rb_mStarRuby, "clear_path_cache",
+                            StarRuby_clear_path_cache, 0);
+  rb_define_module_function(rb_mStarRuby, "path_cache_stats",
+                            StarRuby_path_cache_stats, 0);
+
+  rbCompletePathCache = rb_hash_new();
+  rb_gc_register_address(&rbCompletePathCache);
+#ifdef HAVE_SYS_INOTIFY_H
+  inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+  symbol_entries       = ID2SYM(rb_intern("entries"));
+  symbol_hits          = ID2SYM(rb_intern("hits"));
+  symbol_invalidations = ID2SYM(rb_intern("invalidations"));
+  symbol_misses        = ID2SYM(rb_intern("misses"));
+  symbol_watching      = ID2SYM(rb_intern("watching"));
+
   rb_define_method(rb_cNumeric, "degree",  Numeric_degree, 0);
   rb_define_method(rb_cNumeric, "degrees", Numeric_degree, 0);
 
@@ -23,6 +23,11 @@
 #else
 # include "st.h"
 #endif
+#ifdef HAVE_RUBY_UTIL_H
+# include "ruby/util.h"
+#else
+# include "util.h"
+#endif
 
 #ifdef WIN32
 # include <windows.h>
@@ -58,20 +63,55 @@ typedef union {
 
 typedef struct {
   uint16_t width, height;
+  int pitch;
   Pixel* pixels;
   int paletteSize;
   Color* palette;
   uint8_t* indexes;
+  uint8_t* alphas;
+  VALUE rbParent;
 } Texture;
 
+typedef struct Glyph {
+  uint32_t codepoint;
+  bool antiAlias;
+  int index;
+  int offsetX, offsetY;
+  int width, height;
+  int advance;
+  struct Glyph* hashNext;
+  struct Glyph* prev;
+  struct Glyph* next;
+  uint8_t coverage[];
+} Glyph;
+
+#define GLYPH_BUCKET_COUNT (256)
+
 typedef struct {
   int size;
   TTF_Font* sdlFont;
+  int ascent;
+  Glyph* glyphBuckets[GLYPH_BUCKET_COUNT];
+  Glyph* newestGlyph;
+  Glyph* oldestGlyph;
+  int glyphCount;
+  size_t glyphBytes;
+  unsigned long glyphHits, glyphMisses, glyphEvictions;
+  VALUE rbLayoutCache;
 } Font;
 
+#define BUFFER_ALIGNMENT (64)
+
+typedef struct {
+  void* chunk;
+  size_t offset;
+  size_t used;
+} ScratchMark;
+
 #define MAX(x, y) (((x) >= (y)) ? (x) : (y))
 #define MIN(x, y) (((x) <= (y)) ? (x) : (y))
 #define DIV255(x) ((x) / 255)
+#define ALPHA(src, dst, a) DIV255((dst << 8) - dst + (src - dst) * a)
 
 #define rb_raise_sdl_error() \
   rb_raise(strb_GetStarRubyErrorClass(), "%s", SDL_GetError())
@@ -90,21 +130,37 @@ VALUE strb_GetCompletePath(VALUE, bool);
 
 void strb_GetColorFromRubyValue(Color*, VALUE);
 
+void* strb_AllocBuffer(size_t);
+void strb_FreeBuffer(void*);
+void* strb_AllocScratch(size_t);
+ScratchMark strb_GetScratchMark(void);
+void strb_ReleaseScratch(ScratchMark);
+void strb_ResetScratch(void);
+
 void strb_CheckFont(VALUE);
+uint32_t strb_GetNextCodepoint(const char**);
+const Glyph* strb_GetGlyph(Font*, uint32_t, bool);
+int strb_GetKerning(const Font*, int, int);
+VALUE strb_GetTextLayout(VALUE, VALUE, VALUE);
 void strb_CheckTexture(VALUE);
+void strb_BuildToneTable(uint8_t*, int, int);
 
 VALUE strb_InitializeAudio(VALUE rb_mStarRuby);
 VALUE strb_InitializeColor(VALUE rb_mStarRuby);
 VALUE strb_InitializeGame(VALUE rb_mStarRuby);
 VALUE strb_InitializeFont(VALUE rb_mStarRuby);
 VALUE strb_InitializeInput(VALUE rb_mStarRuby);
+void strb_InitializePool(VALUE rb_mStarRuby);
 VALUE strb_InitializeStarRubyError(VALUE rb_mStarRuby);
 VALUE strb_InitializeTexture(VALUE rb_mStarRuby);
 
-void strb_UpdateInput(void);
+void strb_UpdateAudio(void);
+bool strb_UpdateInput(void);
+bool strb_PollEvents(void);
 
 void strb_FinalizeAudio(void);
 void strb_FinalizeInput(void);
+void strb_FinalizePool(void);
 
 void strb_InitializeSdlAudio(void);
 void strb_InitializeSdlFont(void);
@@ -112,6 +168,7 @@ void strb_InitializeSdlInput(void);
 
 void strb_GetRealScreenSize(int*, int*);
 void strb_GetScreenSize(int*, int*);
+bool strb_IsFlippedScreen(VALUE);
 int strb_GetWindowScale(void);
 
 void strb_CheckDisposedTexture(const Texture* const);
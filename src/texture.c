@@ -2,8 +2,6 @@
 #include "starruby_private.h"
 #include <png.h>
 
-#define ALPHA(src, dst, a) DIV255((dst << 8) - dst + (src - dst) * a)
-
 #define LOOP(process, length) \
   do {                        \
     int n = (length + 7) / 8; \
@@ -24,7 +22,9 @@ static volatile VALUE rb_cTexture = Qundef;
 
 static volatile VALUE symbol_add            = Qundef;
 static volatile VALUE symbol_alpha          = Qundef;
+static volatile VALUE symbol_alpha_only     = Qundef;
 static volatile VALUE symbol_angle          = Qundef;
+static volatile VALUE symbol_anti_alias     = Qundef;
 static volatile VALUE symbol_background     = Qundef;
 static volatile VALUE symbol_blend_type     = Qundef;
 static volatile VALUE symbol_blur           = Qundef;
@@ -36,7 +36,10 @@ static volatile VALUE symbol_camera_y       = Qundef;
 static volatile VALUE symbol_camera_yaw     = Qundef;
 static volatile VALUE symbol_center_x       = Qundef;
 static volatile VALUE symbol_center_y       = Qundef;
+static volatile VALUE symbol_color          = Qundef;
+static volatile VALUE symbol_fill           = Qundef;
 static volatile VALUE symbol_height         = Qundef;
+static volatile VALUE symbol_hue            = Qundef;
 static volatile VALUE symbol_intersection_x = Qundef;
 static volatile VALUE symbol_intersection_y = Qundef;
 static volatile VALUE symbol_io_length      = Qundef;
@@ -44,10 +47,12 @@ static volatile VALUE symbol_loop           = Qundef;
 static volatile VALUE symbol_mask           = Qundef;
 static volatile VALUE symbol_matrix         = Qundef;
 static volatile VALUE symbol_none           = Qundef;
+static volatile VALUE symbol_outline        = Qundef;
 static volatile VALUE symbol_palette        = Qundef;
 static volatile VALUE symbol_saturation     = Qundef;
 static volatile VALUE symbol_scale_x        = Qundef;
 static volatile VALUE symbol_scale_y        = Qundef;
+static volatile VALUE symbol_shadow         = Qundef;
 static volatile VALUE symbol_src_height     = Qundef;
 static volatile VALUE symbol_src_width      = Qundef;
 static volatile VALUE symbol_src_x          = Qundef;
@@ -120,10 +125,21 @@ typedef struct {
   int toneGreen;
   int toneBlue;
   int saturation;
+  double hue;
   BlendType blendType;
   uint8_t alpha;
+  Color color;
 } RenderingTextureOptions;
 
+typedef struct {
+  int outlineWidth;
+  Color outlineColor;
+  bool hasShadow;
+  int shadowX;
+  int shadowY;
+  Color shadowColor;
+} TextEffects;
+
 VALUE
 strb_GetTextureClass(void)
 {
@@ -144,13 +160,20 @@ strb_CheckTexture(VALUE rbTexture)
 inline bool
 strb_IsDisposedTexture(const Texture* const texture)
 {
-  return !texture->pixels;
+  if (!texture->pixels && !texture->alphas) {
+    return true;
+  }
+  if (!NIL_P(texture->rbParent)) {
+    const Texture* parent = (const Texture*)DATA_PTR(texture->rbParent);
+    return !parent->pixels;
+  }
+  return false;
 }
 
 inline void
 strb_CheckDisposedTexture(const Texture* const texture)
 {
-  if (!texture->pixels) {
+  if (strb_IsDisposedTexture(texture)) {
     rb_raise(rb_eRuntimeError,
              "can't modify disposed StarRuby::Texture");
   }
@@ -165,6 +188,15 @@ CheckPalette(const Texture* const texture)
   }
 }
 
+inline static void
+CheckAlphaOnly(const Texture* const texture)
+{
+  if (texture->alphas) {
+    rb_raise(strb_GetStarRubyErrorClass(),
+             "can't use an alpha-only texture for this operation");
+  }
+}
+
 inline static bool
 ModifyRectInTexture(const Texture* texture,
                     int* const x, int* const y, int* const width, int* const height)
@@ -192,6 +224,67 @@ ModifyRectInTexture(const Texture* texture,
   return true;
 }
 
+/*
+ * True if the two textures have a pixel in common. Views of one parent
+ * share its pitch, so their rectangles are compared in rows and columns
+ * of the parent rather than by address spans.
+ */
+inline static bool
+SharesPixels(const Texture* texture1, const Texture* texture2)
+{
+  const uintptr_t begin1 = (uintptr_t)texture1->pixels;
+  const uintptr_t begin2 = (uintptr_t)texture2->pixels;
+  const uintptr_t end1 =
+    (uintptr_t)(texture1->pixels + texture1->pitch * texture1->height);
+  const uintptr_t end2 =
+    (uintptr_t)(texture2->pixels + texture2->pitch * texture2->height);
+  if (!(begin1 < end2 && begin2 < end1)) {
+    return false;
+  }
+  const int pitch = texture1->pitch;
+  if (texture2->pitch != pitch) {
+    return true;
+  }
+  const ptrdiff_t offset = texture2->pixels - texture1->pixels;
+  ptrdiff_t row    = offset / pitch;
+  ptrdiff_t column = offset % pitch;
+  if (column < 0) {
+    column += pitch;
+    row--;
+  }
+  // The second texture starts either column or column - pitch pixels
+  // to the right of the first one
+  return (-texture2->height < row && row < texture1->height &&
+          -texture2->width < column && column < texture1->width) ||
+    (-texture2->height < row + 1 && row + 1 < texture1->height &&
+     -texture2->width < column - pitch && column - pitch < texture1->width);
+}
+
+inline static int
+GetAlignedPitch(int width)
+{
+  const int unit = BUFFER_ALIGNMENT / sizeof(Pixel);
+  return (width + unit - 1) / unit * unit;
+}
+
+inline static int
+GetAlignedAlphaPitch(int width)
+{
+  return (width + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT;
+}
+
+inline static Pixel*
+AllocPixels(int pitch, int height)
+{
+  return (Pixel*)strb_AllocBuffer(sizeof(Pixel) * pitch * height);
+}
+
+inline static void
+FreePixels(Pixel* pixels)
+{
+  strb_FreeBuffer(pixels);
+}
+
 typedef struct {
   char* bytes;
   unsigned long size;
@@ -361,7 +454,7 @@ Texture_s_load(int argc, VALUE* argv, VALUE self)
     png_byte row[width * channels];
     png_read_row(pngPtr, row, NULL);
     for (unsigned int i = 0; i < width; i++, indexes++) {
-      Color* c = &(texture->pixels[width * j + i].color);
+      Color* c = &(texture->pixels[texture->pitch * j + i].color);
       switch (channels) {
       case 1:
         *c = srPalette[*indexes = row[i]];
@@ -388,11 +481,23 @@ Texture_s_load(int argc, VALUE* argv, VALUE self)
   return rbTexture;
 }
 
+static void
+Texture_mark(Texture* texture)
+{
+  if (!NIL_P(texture->rbParent)) {
+    rb_gc_mark(texture->rbParent);
+  }
+}
+
 static void
 Texture_free(Texture* texture)
 {
-  free(texture->pixels);
+  if (NIL_P(texture->rbParent)) {
+    FreePixels(texture->pixels);
+  }
   texture->pixels = NULL;
+  strb_FreeBuffer(texture->alphas);
+  texture->alphas = NULL;
   free(texture->palette);
   texture->palette = NULL;
   free(texture->indexes);
@@ -404,18 +509,29 @@ static VALUE
 Texture_alloc(VALUE klass)
 {
   Texture* texture = ALLOC(Texture);
+  texture->width       = 0;
+  texture->height      = 0;
+  texture->pitch       = 0;
   texture->pixels      = NULL;
   texture->paletteSize = 0;
   texture->palette     = NULL;
   texture->indexes     = NULL;
-  return Data_Wrap_Struct(klass, 0, Texture_free, texture);
+  texture->alphas      = NULL;
+  texture->rbParent    = Qnil;
+  return Data_Wrap_Struct(klass, Texture_mark, Texture_free, texture);
 }
 
 static VALUE
-Texture_initialize(VALUE self, VALUE rbWidth, VALUE rbHeight)
+Texture_initialize(int argc, VALUE* argv, VALUE self)
 {
   Texture* texture;
   Data_Get_Struct(self, Texture, texture);
+  volatile VALUE rbWidth, rbHeight, rbOptions;
+  rb_scan_args(argc, argv, "21", &rbWidth, &rbHeight, &rbOptions);
+  if (NIL_P(rbOptions)) {
+    rbOptions = rb_hash_new();
+  }
+  Check_Type(rbOptions, T_HASH);
   const int width  = NUM2INT(rbWidth);
   const int height = NUM2INT(rbHeight);
   if (width <= 0) {
@@ -426,8 +542,16 @@ Texture_initialize(VALUE self, VALUE rbWidth, VALUE rbHeight)
   }
   texture->width  = width;
   texture->height = height;
-  texture->pixels = ALLOC_N(Pixel, texture->width * texture->height);
-  MEMZERO(texture->pixels, Pixel, texture->width * texture->height);
+  if (RTEST(rb_hash_aref(rbOptions, symbol_alpha_only))) {
+    // Only coverage is stored, one byte per pixel
+    texture->pitch  = GetAlignedAlphaPitch(width);
+    texture->alphas = strb_AllocBuffer(texture->pitch * texture->height);
+    MEMZERO(texture->alphas, uint8_t, texture->pitch * texture->height);
+    return Qnil;
+  }
+  texture->pitch  = GetAlignedPitch(width);
+  texture->pixels = AllocPixels(texture->pitch, texture->height);
+  MEMZERO(texture->pixels, Pixel, texture->pitch * texture->height);
   return Qnil;
 }
 
@@ -440,9 +564,22 @@ Texture_initialize_copy(VALUE self, VALUE rbTexture)
   Data_Get_Struct(rbTexture, Texture, origTexture);
   texture->width  = origTexture->width;
   texture->height = origTexture->height;
+  if (origTexture->alphas) {
+    texture->pitch  = origTexture->pitch;
+    texture->alphas = strb_AllocBuffer(texture->pitch * texture->height);
+    MEMCPY(texture->alphas, origTexture->alphas, uint8_t,
+           texture->pitch * texture->height);
+    return Qnil;
+  }
+  texture->pitch  = GetAlignedPitch(texture->width);
   const int length = texture->width * texture->height;
-  texture->pixels = ALLOC_N(Pixel, length);
-  MEMCPY(texture->pixels, origTexture->pixels, Pixel, length);
+  texture->pixels = AllocPixels(texture->pitch, texture->height);
+  MEMZERO(texture->pixels, Pixel, texture->pitch * texture->height);
+  for (int j = 0; j < texture->height; j++) {
+    MEMCPY(&(texture->pixels[j * texture->pitch]),
+           &(origTexture->pixels[j * origTexture->pitch]),
+           Pixel, texture->width);
+  }
   if (origTexture->palette) {
     const int paletteSize = texture->paletteSize = origTexture->paletteSize;
     texture->palette = ALLOC_N(Color, paletteSize);
@@ -464,7 +601,12 @@ Texture_aref(VALUE self, VALUE rbX, VALUE rbY)
   if (x < 0 || texture->width <= x || y < 0 || texture->height <= y) {
     rb_raise(rb_eArgError, "index out of range: (%d, %d)", x, y);
   }
-  const Color color = texture->pixels[x + y * texture->width].color;
+  if (texture->alphas) {
+    return rb_funcall(strb_GetColorClass(), rb_intern("new"), 4,
+                      INT2FIX(255), INT2FIX(255), INT2FIX(255),
+                      INT2FIX(texture->alphas[x + y * texture->pitch]));
+  }
+  const Color color = texture->pixels[x + y * texture->pitch].color;
   return rb_funcall(strb_GetColorClass(), rb_intern("new"), 4,
                     INT2FIX(color.red),
                     INT2FIX(color.green),
@@ -487,10 +629,22 @@ Texture_aset(VALUE self, VALUE rbX, VALUE rbY, VALUE rbColor)
   }
   Color color;
   strb_GetColorFromRubyValue(&color, rbColor);
-  texture->pixels[x + y * texture->width].color = color;
+  if (texture->alphas) {
+    texture->alphas[x + y * texture->pitch] = color.alpha;
+    return rbColor;
+  }
+  texture->pixels[x + y * texture->pitch].color = color;
   return rbColor;
 }
 
+static VALUE
+Texture_alpha_only(VALUE self)
+{
+  const Texture* texture;
+  Data_Get_Struct(self, Texture, texture);
+  return texture->alphas ? Qtrue : Qfalse;
+}
+
 static VALUE Texture_change_hue_bang(VALUE, VALUE);
 static VALUE
 Texture_change_hue(VALUE self, VALUE rbAngle)
@@ -559,15 +713,20 @@ Texture_change_hue_bang(VALUE self, VALUE rbAngle)
   const Texture* texture;
   Data_Get_Struct(self, Texture, texture);
   strb_CheckDisposedTexture(texture);
+  CheckAlphaOnly(texture);
   const double angle = NUM2DBL(rbAngle);
   if (angle == 0) {
     return Qnil;
   }
   Pixel* pixels = texture->pixels;
+  const int width   = texture->width;
+  const int height  = texture->height;
+  const int padding = texture->pitch - width;
   if (!texture->palette) {
-    const int length = texture->width * texture->height;
-    for (int i = 0; i < length; i++, pixels++) {
-      ChangeHue(&(pixels->color), angle);
+    for (int j = 0; j < height; j++, pixels += padding) {
+      for (int i = 0; i < width; i++, pixels++) {
+        ChangeHue(&(pixels->color), angle);
+      }
     }
   } else {
     const int paletteSize = texture->paletteSize;
@@ -577,9 +736,10 @@ Texture_change_hue_bang(VALUE self, VALUE rbAngle)
     }
     palette = texture->palette;
     uint8_t* indexes = texture->indexes;
-    const int length = texture->width * texture->height;
-    for (int i = 0; i < length; i++, pixels++, indexes++) {
-      pixels->color = palette[*indexes];
+    for (int j = 0; j < height; j++, pixels += padding) {
+      for (int i = 0; i < width; i++, pixels++, indexes++) {
+        pixels->color = palette[*indexes];
+      }
     }
   }
   return Qnil;
@@ -620,9 +780,13 @@ Texture_change_palette_bang(VALUE self, VALUE rbPalette)
   Pixel* pixels = texture->pixels;
   palette = texture->palette;
   const uint8_t* indexes = texture->indexes;
-  const int length = texture->width * texture->height;
-  for (int i = 0; i < length; i++, pixels++, indexes++) {
-    pixels->color = palette[*indexes];
+  const int width   = texture->width;
+  const int height  = texture->height;
+  const int padding = texture->pitch - width;
+  for (int j = 0; j < height; j++, pixels += padding) {
+    for (int i = 0; i < width; i++, pixels++, indexes++) {
+      pixels->color = palette[*indexes];
+    }
   }
   return Qnil;
 }
@@ -635,7 +799,15 @@ Texture_clear(VALUE self)
   Data_Get_Struct(self, Texture, texture);
   strb_CheckDisposedTexture(texture);
   CheckPalette(texture);
-  MEMZERO(texture->pixels, Color, texture->width * texture->height);
+  if (texture->alphas) {
+    MEMZERO(texture->alphas, uint8_t, texture->pitch * texture->height);
+  } else if (texture->pitch == texture->width) {
+    MEMZERO(texture->pixels, Pixel, texture->width * texture->height);
+  } else {
+    for (int j = 0; j < texture->height; j++) {
+      MEMZERO(&(texture->pixels[j * texture->pitch]), Pixel, texture->width);
+    }
+  }
   return self;
 }
 
@@ -644,8 +816,12 @@ Texture_dispose(VALUE self)
 {
   Texture* texture;
   Data_Get_Struct(self, Texture, texture);
-  free(texture->pixels);
+  if (NIL_P(texture->rbParent)) {
+    FreePixels(texture->pixels);
+  }
   texture->pixels = NULL;
+  strb_FreeBuffer(texture->alphas);
+  texture->alphas = NULL;
   free(texture->palette);
   texture->palette = NULL;
   free(texture->indexes);
@@ -658,7 +834,7 @@ Texture_disposed(VALUE self)
 {
   const Texture* texture;
   Data_Get_Struct(self, Texture, texture);
-  return !texture->pixels ? Qtrue : Qfalse;
+  return strb_IsDisposedTexture(texture) ? Qtrue : Qfalse;
 }
 
 static VALUE
@@ -672,14 +848,28 @@ Texture_dump(VALUE self, VALUE rbFormat)
   const int pixelLength = texture->width * texture->height;
   volatile VALUE rbResult = rb_str_new(NULL, pixelLength * formatLength);
   uint8_t* strPtr = (uint8_t*)RSTRING_PTR(rbResult);
+  if (texture->alphas) {
+    for (int j = 0; j < texture->height; j++) {
+      const uint8_t* alphas = &(texture->alphas[j * texture->pitch]);
+      for (int i = 0; i < texture->width; i++, alphas++) {
+        for (int k = 0; k < formatLength; k++, strPtr++) {
+          *strPtr = (format[k] == 'a') ? *alphas : 255;
+        }
+      }
+    }
+    return rbResult;
+  }
   const Pixel* pixels = texture->pixels;
-  for (int i = 0; i < pixelLength; i++, pixels++) {
-    for (int j = 0; j < formatLength; j++, strPtr++) {
-      switch (format[j]) {
-      case 'r': *strPtr = pixels->color.red;   break;
-      case 'g': *strPtr = pixels->color.green; break;
-      case 'b': *strPtr = pixels->color.blue;  break;
-      case 'a': *strPtr = pixels->color.alpha; break;
+  const int padding = texture->pitch - texture->width;
+  for (int j = 0; j < texture->height; j++, pixels += padding) {
+    for (int i = 0; i < texture->width; i++, pixels++) {
+      for (int k = 0; k < formatLength; k++, strPtr++) {
+        switch (format[k]) {
+        case 'r': *strPtr = pixels->color.red;   break;
+        case 'g': *strPtr = pixels->color.green; break;
+        case 'b': *strPtr = pixels->color.blue;  break;
+        case 'a': *strPtr = pixels->color.alpha; break;
+        }
       }
     }
   }
@@ -696,14 +886,40 @@ Texture_fill(VALUE self, VALUE rbColor)
   CheckPalette(texture);
   Color color;
   strb_GetColorFromRubyValue(&color, rbColor);
-  const int length = texture->width * texture->height;
+  if (texture->alphas) {
+    memset(texture->alphas, color.alpha, texture->pitch * texture->height);
+    return self;
+  }
   Pixel* pixels = texture->pixels;
-  for (int i = 0; i < length; i++, pixels++) {
-    pixels->color = color;
+  const int padding = texture->pitch - texture->width;
+  for (int j = 0; j < texture->height; j++, pixels += padding) {
+    for (int i = 0; i < texture->width; i++, pixels++) {
+      pixels->color = color;
+    }
   }
   return self;
 }
 
+static void
+FillRect(const Texture* texture, int rectX, int rectY,
+         int rectWidth, int rectHeight, Color color)
+{
+  if (texture->alphas) {
+    for (int j = rectY; j < rectY + rectHeight; j++) {
+      memset(&(texture->alphas[rectX + j * texture->pitch]),
+             color.alpha, rectWidth);
+    }
+    return;
+  }
+  Pixel* pixels = &(texture->pixels[rectX + rectY * texture->pitch]);
+  const int paddingJ = texture->pitch - rectWidth;
+  for (int j = rectY; j < rectY + rectHeight; j++, pixels += paddingJ) {
+    for (int i = rectX; i < rectX + rectWidth; i++, pixels++) {
+      pixels->color = color;
+    }
+  }
+}
+
 static VALUE
 Texture_fill_rect(VALUE self, VALUE rbX, VALUE rbY,
                   VALUE rbWidth, VALUE rbHeight, VALUE rbColor)
@@ -722,13 +938,7 @@ Texture_fill_rect(VALUE self, VALUE rbX, VALUE rbY,
   }
   Color color;
   strb_GetColorFromRubyValue(&color, rbColor);  
-  Pixel* pixels = &(texture->pixels[rectX + rectY * texture->width]);
-  const int paddingJ = texture->width - rectWidth;
-  for (int j = rectY; j < rectY + rectHeight; j++, pixels += paddingJ) {
-    for (int i = rectX; i < rectX + rectWidth; i++, pixels++) {
-      pixels->color = color;
-    }
-  }
+  FillRect(texture, rectX, rectY, rectWidth, rectHeight, color);
   return self;
 }
 
@@ -888,11 +1098,13 @@ Texture_render_in_perspective(int argc, VALUE* argv, VALUE self)
   const Texture* srcTexture;
   Data_Get_Struct(rbTexture, Texture, srcTexture);
   strb_CheckDisposedTexture(srcTexture);
+  CheckAlphaOnly(srcTexture);
   const Texture* dstTexture;
   Data_Get_Struct(self, Texture, dstTexture);
   strb_CheckDisposedTexture(dstTexture);
   CheckPalette(dstTexture);
-  if (srcTexture == dstTexture) {
+  CheckAlphaOnly(dstTexture);
+  if (SharesPixels(srcTexture, dstTexture)) {
     rb_raise(rb_eRuntimeError, "can't render self in perspective");
   }
   PerspectiveOptions options;
@@ -902,8 +1114,10 @@ Texture_render_in_perspective(int argc, VALUE* argv, VALUE self)
   }
   const int srcWidth  = srcTexture->width;
   const int srcHeight = srcTexture->height;
+  const int srcPitch  = srcTexture->pitch;
   const int dstWidth  = dstTexture->width;
   const int dstHeight = dstTexture->height;
+  const int dstPadding = dstTexture->pitch - dstWidth;
   const double cosYaw   = cos(options.cameraYaw);
   const double sinYaw   = sin(options.cameraYaw);
   const double cosPitch = cos(options.cameraPitch);
@@ -941,7 +1155,7 @@ Texture_render_in_perspective(int argc, VALUE* argv, VALUE self)
   const Pixel* src = srcTexture->pixels;
   Pixel* dst = dstTexture->pixels;
   PointF screenP;
-  for (int j = 0; j < dstHeight; j++) {
+  for (int j = 0; j < dstHeight; j++, dst += dstPadding) {
     screenP.x = screenO.x + j * screenDY.x;
     screenP.y = screenO.y + j * screenDY.y;
     screenP.z = screenO.z + j * screenDY.z;
@@ -964,7 +1178,7 @@ Texture_render_in_perspective(int argc, VALUE* argv, VALUE self)
           }
           if (options.isLoop ||
               (0 <= srcX && srcX < srcWidth && 0 <= srcZ && srcZ < srcHeight)) {
-            const Color* srcColor = &(src[srcX + srcZ * srcWidth].color);
+            const Color* srcColor = &(src[srcX + srcZ * srcPitch].color);
             if (options.blurType == BLUR_TYPE_NONE || scale <= 1) {
               RENDER_PIXEL(dst->color, (*srcColor));
             } else {
@@ -1009,6 +1223,7 @@ Texture_render_line(VALUE self,
   const Texture* texture;
   Data_Get_Struct(self, Texture, texture);
   strb_CheckDisposedTexture(texture);
+  CheckAlphaOnly(texture);
   CheckPalette(texture);
   Color color;
   strb_GetColorFromRubyValue(&color, rbColor);
@@ -1023,7 +1238,7 @@ Texture_render_line(VALUE self,
     const int eLimit = dx << 1;
     for (int i = 0; i <= dx; i++) {
       if (0 <= x && x < texture->width && 0 <= y && y < texture->height) {
-        Pixel* pixel = &(texture->pixels[x + y * texture->width]);
+        Pixel* pixel = &(texture->pixels[x + y * texture->pitch]);
         RENDER_PIXEL(pixel->color, color);
       }
       x += signX;
@@ -1038,7 +1253,7 @@ Texture_render_line(VALUE self,
     const int eLimit = dy << 1;
     for (int i = 0; i <= dy; i++) {
       if (0 <= x && x < texture->width && 0 <= y && y < texture->height) {
-        Pixel* pixel = &(texture->pixels[x + y * texture->width]);
+        Pixel* pixel = &(texture->pixels[x + y * texture->pitch]);
         RENDER_PIXEL(pixel->color, color);
       }
       y += signY;
@@ -1059,6 +1274,7 @@ Texture_render_pixel(VALUE self, VALUE rbX, VALUE rbY, VALUE rbColor)
   const Texture* texture;
   Data_Get_Struct(self, Texture, texture);
   strb_CheckDisposedTexture(texture);
+  CheckAlphaOnly(texture);
   CheckPalette(texture);
   const int x = NUM2INT(rbX);
   const int y = NUM2INT(rbY);
@@ -1067,7 +1283,7 @@ Texture_render_pixel(VALUE self, VALUE rbX, VALUE rbY, VALUE rbColor)
   }
   Color color;
   strb_GetColorFromRubyValue(&color, rbColor);
-  Pixel* pixel = &(texture->pixels[x + y * texture->width]);
+  Pixel* pixel = &(texture->pixels[x + y * texture->pitch]);
   RENDER_PIXEL(pixel->color, color);
   return self;
 }
@@ -1080,6 +1296,7 @@ Texture_render_rect(VALUE self, VALUE rbX, VALUE rbY,
   const Texture* texture;
   Data_Get_Struct(self, Texture, texture);
   strb_CheckDisposedTexture(texture);
+  CheckAlphaOnly(texture);
   CheckPalette(texture);
   int rectX = NUM2INT(rbX);
   int rectY = NUM2INT(rbY);
@@ -1090,8 +1307,8 @@ Texture_render_rect(VALUE self, VALUE rbX, VALUE rbY,
   }
   Color color;
   strb_GetColorFromRubyValue(&color, rbColor);
-  Pixel* pixels = &(texture->pixels[rectX + rectY * texture->width]);
-  const int paddingJ = texture->width - rectWidth;
+  Pixel* pixels = &(texture->pixels[rectX + rectY * texture->pitch]);
+  const int paddingJ = texture->pitch - rectWidth;
   for (int j = rectY; j < rectY + rectHeight; j++, pixels += paddingJ) {
     for (int i = rectX; i < rectX + rectWidth; i++, pixels++) {
       RENDER_PIXEL(pixels->color, color);
@@ -1100,77 +1317,387 @@ Texture_render_rect(VALUE self, VALUE rbX, VALUE rbY,
   return self;
 }
 
-static VALUE Texture_render_texture(int, VALUE*, VALUE);
+inline static void
+BlendPixel(Pixel* dst, Color color, uint8_t beta)
+{
+  const uint8_t dstAlpha = dst->color.alpha;
+  if ((beta == 255) | (dstAlpha == 0)) {
+    dst->color = color;
+    dst->color.alpha = beta;
+  } else if (beta) {
+    if (dstAlpha < beta) {
+      dst->color.alpha = beta;
+    }
+    dst->color.red   = ALPHA(color.red,   dst->color.red,   beta);
+    dst->color.green = ALPHA(color.green, dst->color.green, beta);
+    dst->color.blue  = ALPHA(color.blue,  dst->color.blue,  beta);
+  }
+}
+
+static void
+RenderCoverage(const uint8_t* coverage, int coveragePitch,
+               int srcX, int srcY, int srcWidth, int srcHeight,
+               const Texture* dstTexture, int dstX, int dstY,
+               Color color, uint8_t alpha, BlendType blendType)
+{
+  if (dstX < 0) {
+    srcX -= dstX;
+    srcWidth += dstX;
+    dstX = 0;
+  }
+  if (dstY < 0) {
+    srcY -= dstY;
+    srcHeight += dstY;
+    dstY = 0;
+  }
+  const int width  = MIN(srcWidth,  dstTexture->width  - dstX);
+  const int height = MIN(srcHeight, dstTexture->height - dstY);
+  if (width <= 0 || height <= 0 ||
+      (blendType == BLEND_TYPE_ALPHA && alpha == 0)) {
+    return;
+  }
+  for (int j = 0; j < height; j++) {
+    const uint8_t* src = &(coverage[srcX + (srcY + j) * coveragePitch]);
+    if (dstTexture->alphas) {
+      // Coverage is accumulated as in the alpha blending of white
+      uint8_t* dst =
+        &(dstTexture->alphas[dstX + (dstY + j) * dstTexture->pitch]);
+      for (int i = 0; i < width; i++, src++, dst++) {
+        uint8_t beta =
+          (color.alpha == 255) ? *src : DIV255(*src * color.alpha);
+        if (alpha < 255) {
+          beta = DIV255(beta * alpha);
+        }
+        if (*dst < beta) {
+          *dst = beta;
+        }
+      }
+      continue;
+    }
+    Pixel* dst = &(dstTexture->pixels[dstX + (dstY + j) * dstTexture->pitch]);
+    if (blendType == BLEND_TYPE_MASK) {
+      for (int i = 0; i < width; i++, src++, dst++) {
+        dst->color.alpha = *src;
+      }
+      continue;
+    }
+    for (int i = 0; i < width; i++, src++, dst++) {
+      uint8_t beta =
+        (color.alpha == 255) ? *src : DIV255(*src * color.alpha);
+      if (alpha < 255) {
+        beta = DIV255(beta * alpha);
+      }
+      BlendPixel(dst, color, beta);
+    }
+  }
+}
+
+static void
+AssignTextEffects(TextEffects* effects, VALUE rbOptions)
+{
+  effects->outlineWidth = 0;
+  effects->hasShadow    = false;
+  effects->shadowX      = 0;
+  effects->shadowY      = 0;
+  if (NIL_P(rbOptions)) {
+    return;
+  }
+  volatile VALUE val;
+  if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_outline))) {
+    Check_Type(val, T_ARRAY);
+    if (RARRAY_LEN(val) != 2) {
+      rb_raise(rb_eArgError, "outline must be [color, width]");
+    }
+    strb_GetColorFromRubyValue(&(effects->outlineColor),
+                               rb_ary_entry(val, 0));
+    effects->outlineWidth = NUM2INT(rb_ary_entry(val, 1));
+    if (effects->outlineWidth < 0) {
+      rb_raise(rb_eArgError, "invalid outline width: %d",
+               effects->outlineWidth);
+    }
+  }
+  if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_shadow))) {
+    Check_Type(val, T_ARRAY);
+    if (RARRAY_LEN(val) != 3) {
+      rb_raise(rb_eArgError, "shadow must be [color, dx, dy]");
+    }
+    strb_GetColorFromRubyValue(&(effects->shadowColor),
+                               rb_ary_entry(val, 0));
+    effects->shadowX   = NUM2INT(rb_ary_entry(val, 1));
+    effects->shadowY   = NUM2INT(rb_ary_entry(val, 2));
+    effects->hasShadow = true;
+  }
+}
+
+/*
+ * Clips the span [start, start + length) to [0, limit). The span may lie
+ * far outside of the int range after an offset.
+ */
+inline static void
+ClipSpan(int64_t start, int length, int limit, int* begin, int* end)
+{
+  *begin = (int)MIN(MAX(start, 0), (int64_t)limit);
+  *end   = (int)MIN(MAX(start + length, (int64_t)*begin), (int64_t)limit);
+}
+
+static void
+RenderTextWithEffects(Font* font, const char* text, const Texture* dstTexture,
+                      int x, int y, Color color, bool antiAlias,
+                      const TextEffects* effects)
+{
+  // The bounding box of the fill coverage
+  int boxX0 = INT_MAX, boxY0 = INT_MAX, boxX1 = INT_MIN, boxY1 = INT_MIN;
+  const char* p = text;
+  int penX = 0;
+  int prevIndex = 0;
+  uint32_t codepoint;
+  while ((codepoint = strb_GetNextCodepoint(&p))) {
+    const Glyph* glyph = strb_GetGlyph(font, codepoint, antiAlias);
+    penX += strb_GetKerning(font, prevIndex, glyph->index);
+    if (glyph->width && glyph->height) {
+      boxX0 = MIN(boxX0, penX + glyph->offsetX);
+      boxY0 = MIN(boxY0, glyph->offsetY);
+      boxX1 = MAX(boxX1, penX + glyph->offsetX + glyph->width);
+      boxY1 = MAX(boxY1, glyph->offsetY + glyph->height);
+    }
+    penX += glyph->advance;
+    prevIndex = glyph->index;
+  }
+  if (boxX1 <= boxX0 || boxY1 <= boxY0) {
+    return;
+  }
+
+  /*
+   * Fill and outline share one canvas that covers the outlined text.
+   * (originX, originY) is where the pen starts in the canvas. The shadow is
+   * read from the same canvas at its offset, so the offset costs nothing.
+   */
+  const int outlineWidth = effects->outlineWidth;
+  const int width  = boxX1 - boxX0 + outlineWidth * 2;
+  const int height = boxY1 - boxY0 + outlineWidth * 2;
+  const int originX = outlineWidth - boxX0;
+  const int originY = outlineWidth - boxY0;
+  const int length = width * height;
+  const ScratchMark scratchMark = strb_GetScratchMark();
+  uint8_t* fill = strb_AllocScratch(length * 2);
+  uint8_t* outline = fill + length;
+  MEMZERO(fill, uint8_t, length * 2);
+
+  p = text;
+  penX = originX;
+  prevIndex = 0;
+  while ((codepoint = strb_GetNextCodepoint(&p))) {
+    const Glyph* glyph = strb_GetGlyph(font, codepoint, antiAlias);
+    penX += strb_GetKerning(font, prevIndex, glyph->index);
+    for (int j = 0; j < glyph->height; j++) {
+      const uint8_t* src = &(glyph->coverage[j * glyph->width]);
+      uint8_t* dst = &(fill[penX + glyph->offsetX +
+                            (originY + glyph->offsetY + j) * width]);
+      for (int i = 0; i < glyph->width; i++, src++, dst++) {
+        *dst = MAX(*dst, *src);
+      }
+    }
+    penX += glyph->advance;
+    prevIndex = glyph->index;
+  }
+
+  // The outline is the fill dilated by a disc of the outline width
+  const uint8_t* silhouette = fill;
+  if (outlineWidth) {
+    const int r2 = outlineWidth * outlineWidth;
+    for (int j = 0; j < height; j++) {
+      for (int i = 0; i < width; i++) {
+        uint8_t value = 0;
+        for (int dy = -outlineWidth; dy <= outlineWidth && value < 255; dy++) {
+          const int jj = j + dy;
+          if (jj < 0 || height <= jj) {
+            continue;
+          }
+          const int dxMax = (int)sqrt(r2 - dy * dy);
+          const uint8_t* row = &(fill[jj * width]);
+          for (int dx = -dxMax; dx <= dxMax; dx++) {
+            const int ii = i + dx;
+            if (0 <= ii && ii < width && value < row[ii]) {
+              value = row[ii];
+            }
+          }
+        }
+        outline[i + j * width] = value;
+      }
+    }
+    silhouette = outline;
+  }
+
+  // The canvas and the shadow are clipped to the destination separately
+  const int64_t canvasX = (int64_t)x - originX;
+  const int64_t canvasY = (int64_t)y - originY;
+  int fillX0, fillX1, fillY0, fillY1;
+  ClipSpan(canvasX, width,  dstTexture->width,  &fillX0, &fillX1);
+  ClipSpan(canvasY, height, dstTexture->height, &fillY0, &fillY1);
+  const int64_t shadowCanvasX = canvasX + effects->shadowX;
+  const int64_t shadowCanvasY = canvasY + effects->shadowY;
+  int shadowX0 = 0, shadowX1 = 0, shadowY0 = 0, shadowY1 = 0;
+  if (effects->hasShadow) {
+    ClipSpan(shadowCanvasX, width,  dstTexture->width,  &shadowX0, &shadowX1);
+    ClipSpan(shadowCanvasY, height, dstTexture->height, &shadowY0, &shadowY1);
+  }
+  if (fillX1 <= fillX0 || fillY1 <= fillY0) {
+    fillY0 = fillY1 = 0;
+  }
+  if (shadowX1 <= shadowX0 || shadowY1 <= shadowY0) {
+    shadowY0 = shadowY1 = 0;
+  }
+
+  // Shadow, outline and fill are composited in one pass
+  const int rowY0 = (fillY0 == fillY1) ? shadowY0 :
+    (shadowY0 == shadowY1) ? fillY0 : MIN(fillY0, shadowY0);
+  const int rowY1 = MAX(fillY1, shadowY1);
+  for (int j = rowY0; j < rowY1; j++) {
+    const bool isFillRow   = fillY0   <= j && j < fillY1;
+    const bool isShadowRow = shadowY0 <= j && j < shadowY1;
+    if (!isFillRow && !isShadowRow) {
+      continue;
+    }
+    const int i0 = !isShadowRow ? fillX0 :
+      !isFillRow ? shadowX0 : MIN(fillX0, shadowX0);
+    const int i1 = !isShadowRow ? fillX1 :
+      !isFillRow ? shadowX1 : MAX(fillX1, shadowX1);
+    // The rows of the canvas and of the shadow from their first visible pixel
+    const int fillStart = !isFillRow ? 0 :
+      (int)(j - canvasY) * width + (int)(fillX0 - canvasX);
+    const int shadowStart = !isShadowRow ? 0 :
+      (int)(j - shadowCanvasY) * width + (int)(shadowX0 - shadowCanvasX);
+    for (int i = i0; i < i1; i++) {
+      uint8_t f = 0, o = 0, s = 0;
+      if (isFillRow && fillX0 <= i && i < fillX1) {
+        f = fill[fillStart + i - fillX0];
+        o = outline[fillStart + i - fillX0];
+      }
+      if (isShadowRow && shadowX0 <= i && i < shadowX1) {
+        s = silhouette[shadowStart + i - shadowX0];
+      }
+      if (dstTexture->alphas) {
+        uint8_t* dst = &(dstTexture->alphas[i + j * dstTexture->pitch]);
+        const uint8_t beta = MAX(MAX(DIV255(s * effects->shadowColor.alpha),
+                                     DIV255(o * effects->outlineColor.alpha)),
+                                 DIV255(f * color.alpha));
+        if (*dst < beta) {
+          *dst = beta;
+        }
+        continue;
+      }
+      Pixel* dst = &(dstTexture->pixels[i + j * dstTexture->pitch]);
+      if (s) {
+        BlendPixel(dst, effects->shadowColor,
+                   DIV255(s * effects->shadowColor.alpha));
+      }
+      if (o) {
+        BlendPixel(dst, effects->outlineColor,
+                   DIV255(o * effects->outlineColor.alpha));
+      }
+      if (f) {
+        BlendPixel(dst, color, DIV255(f * color.alpha));
+      }
+    }
+  }
+  strb_ReleaseScratch(scratchMark);
+}
+
+static void
+RenderText(Font* font, const char* text, const Texture* dstTexture,
+           int x, int y, Color color, bool antiAlias,
+           const TextEffects* effects)
+{
+  if (effects->outlineWidth || effects->hasShadow) {
+    RenderTextWithEffects(font, text, dstTexture, x, y,
+                          color, antiAlias, effects);
+    return;
+  }
+  // Glyphs are composited one by one from the font's glyph cache
+  const char* p = text;
+  int penX = x;
+  int prevIndex = 0;
+  uint32_t codepoint;
+  while ((codepoint = strb_GetNextCodepoint(&p))) {
+    const Glyph* glyph = strb_GetGlyph(font, codepoint, antiAlias);
+    penX += strb_GetKerning(font, prevIndex, glyph->index);
+    RenderCoverage(glyph->coverage, glyph->width,
+                   0, 0, glyph->width, glyph->height, dstTexture,
+                   penX + glyph->offsetX, y + glyph->offsetY,
+                   color, 255, BLEND_TYPE_ALPHA);
+    penX += glyph->advance;
+    prevIndex = glyph->index;
+  }
+}
+
 static VALUE
 Texture_render_text(int argc, VALUE* argv, VALUE self)
 {
-  volatile VALUE rbText, rbX, rbY, rbFont, rbColor, rbAntiAlias;
-  rb_scan_args(argc, argv, "51",
-               &rbText, &rbX, &rbY, &rbFont, &rbColor, &rbAntiAlias);
+  volatile VALUE rbText, rbX, rbY, rbFont, rbColor, rbAntiAlias, rbOptions;
+  rb_scan_args(argc, argv, "52", &rbText, &rbX, &rbY, &rbFont, &rbColor,
+               &rbAntiAlias, &rbOptions);
+  if (argc == 6 && TYPE(rbAntiAlias) == T_HASH) {
+    rbOptions = rbAntiAlias;
+    rbAntiAlias = rb_hash_aref(rbOptions, symbol_anti_alias);
+  } else if (!NIL_P(rbOptions)) {
+    Check_Type(rbOptions, T_HASH);
+  }
   Check_Type(rbText, T_STRING);
   if (!(RSTRING_LEN(rbText))) {
     return self;
   }
   const bool antiAlias = RTEST(rbAntiAlias);
+  TextEffects effects;
+  AssignTextEffects(&effects, rbOptions);
   const char* text = StringValueCStr(rbText);
   strb_CheckFont(rbFont);
-  const Font* font;
+  const int x = NUM2INT(rbX);
+  const int y = NUM2INT(rbY);
+  Color color;
+  strb_GetColorFromRubyValue(&color, rbColor);
+  rb_check_frozen(self);
+  const Texture* dstTexture;
+  Data_Get_Struct(self, Texture, dstTexture);
+  strb_CheckDisposedTexture(dstTexture);
+  CheckPalette(dstTexture);
+
+  Font* font;
   Data_Get_Struct(rbFont, Font, font);
-  volatile VALUE rbSize = rb_funcall(rbFont, rb_intern("get_size"), 1, rbText);
-  volatile VALUE rbTextTexture =
-    rb_class_new_instance(2, RARRAY_PTR(rbSize), rb_cTexture);
-  const Texture* textTexture;
-  Data_Get_Struct(rbTextTexture, Texture, textTexture);
+  RenderText(font, text, dstTexture, x, y, color, antiAlias, &effects);
+  return self;
+}
+
+static VALUE
+Texture_render_text_block(int argc, VALUE* argv, VALUE self)
+{
+  volatile VALUE rbText, rbX, rbY, rbFont, rbColor, rbOptions;
+  rb_scan_args(argc, argv, "51",
+               &rbText, &rbX, &rbY, &rbFont, &rbColor, &rbOptions);
+  volatile VALUE rbLines = strb_GetTextLayout(rbFont, rbText, rbOptions);
+  const bool antiAlias =
+    !NIL_P(rbOptions) && RTEST(rb_hash_aref(rbOptions, symbol_anti_alias));
+  TextEffects effects;
+  AssignTextEffects(&effects, rbOptions);
+  const int x = NUM2INT(rbX);
+  const int y = NUM2INT(rbY);
   Color color;
   strb_GetColorFromRubyValue(&color, rbColor);
+  rb_check_frozen(self);
+  const Texture* dstTexture;
+  Data_Get_Struct(self, Texture, dstTexture);
+  strb_CheckDisposedTexture(dstTexture);
+  CheckPalette(dstTexture);
 
-  SDL_Surface* textSurfaceRaw;
-  if (antiAlias) {
-    textSurfaceRaw =
-      TTF_RenderUTF8_Shaded(font->sdlFont, text,
-                            (SDL_Color){255, 255, 255, 255},
-                            (SDL_Color){0, 0, 0, 0});
-  } else {
-    textSurfaceRaw =
-      TTF_RenderUTF8_Solid(font->sdlFont, text,
-                           (SDL_Color){255, 255, 255, 255});
-  }
-  if (!textSurfaceRaw) {
-    rb_raise_sdl_ttf_error();
-  }
-  SDL_PixelFormat format = {
-    .palette = NULL, .BitsPerPixel = 32, .BytesPerPixel = 4,
-    .Rmask = 0x00ff0000, .Gmask = 0x0000ff00,
-    .Bmask = 0x000000ff, .Amask = 0xff000000,
-    .colorkey = 0, .alpha = 255,
-  };
-  SDL_Surface* textSurface =
-    SDL_ConvertSurface(textSurfaceRaw, &format, SDL_SWSURFACE);
-  SDL_FreeSurface(textSurfaceRaw);
-  textSurfaceRaw = NULL;
-  if (!textSurface) {
-    rb_raise_sdl_error();
-  }
-  SDL_LockSurface(textSurface);
-  const Pixel* src = (Pixel*)(textSurface->pixels);
-  Pixel* dst = textTexture->pixels;
-  const int size = textTexture->width * textTexture->height;
-  for (int i = 0; i < size; i++, src++, dst++) {
-    if (src->value) {
-      dst->color = color;
-      if (color.alpha == 255) {
-        dst->color.alpha = src->color.red;
-      } else {
-        dst->color.alpha = DIV255(src->color.red * color.alpha);
-      }
-    }
+  Font* font;
+  Data_Get_Struct(rbFont, Font, font);
+  for (int i = 0; i < RARRAY_LEN(rbLines); i++) {
+    volatile VALUE rbLine = rb_ary_entry(rbLines, i);
+    volatile VALUE rbLineText = rb_ary_entry(rbLine, 0);
+    RenderText(font, StringValueCStr(rbLineText), dstTexture,
+               x + NUM2INT(rb_ary_entry(rbLine, 1)),
+               y + NUM2INT(rb_ary_entry(rbLine, 2)),
+               color, antiAlias, &effects);
   }
-  SDL_UnlockSurface(textSurface);
-  SDL_FreeSurface(textSurface);
-  textSurface = NULL;
-
-  Texture_render_texture(3, (VALUE[]){rbTextTexture, rbX, rbY}, self);
-  Texture_dispose(rbTextTexture);
   return self;
 }
 
@@ -1260,10 +1787,99 @@ AssignRenderingTextureOptions(st_data_t key, st_data_t val,
     options->toneBlue = NUM2INT(val);
   } else if (key == symbol_saturation) {
     options->saturation = NUM2INT(val);
+  } else if (key == symbol_hue) {
+    options->hue = NUM2DBL(val);
+  } else if (key == symbol_color) {
+    strb_GetColorFromRubyValue(&(options->color), val);
   }
   return ST_CONTINUE;
 }
 
+/*
+ * Blends a source color into a destination color.
+ * BETA_ALPHA and BETA_OPAQUE compute the source alpha with or without
+ * the global alpha.
+ */
+#define BETA_OPAQUE(a) (a)
+#define BETA_ALPHA(a)  DIV255((a) * alpha)
+
+#define BLEND_PIXEL_NONE(_dst, _src, _betaOf)                            \
+  do {                                                                   \
+    _dst = _src;                                                         \
+  } while (false)
+
+#define BLEND_PIXEL_MASK(_dst, _src, _betaOf)                            \
+  do {                                                                   \
+    _dst.alpha = _src.red;                                               \
+  } while (false)
+
+#define BLEND_PIXEL_ALPHA(_dst, _src, _betaOf)                           \
+  do {                                                                   \
+    const uint8_t _beta = _betaOf(_src.alpha);                           \
+    if (_dst.alpha == 0) {                                               \
+      _dst.red   = _src.red;                                             \
+      _dst.green = _src.green;                                           \
+      _dst.blue  = _src.blue;                                            \
+      _dst.alpha = _beta;                                                \
+    } else {                                                             \
+      if (_dst.alpha < _beta) {                                          \
+        _dst.alpha = _beta;                                              \
+      }                                                                  \
+      _dst.red   = ALPHA(_src.red, _dst.red,   _beta);                   \
+      _dst.green = ALPHA(_src.green, _dst.green, _beta);                 \
+      _dst.blue  = ALPHA(_src.blue, _dst.blue,  _beta);                  \
+    }                                                                    \
+  } while (false)
+
+#define BLEND_PIXEL_ADD(_dst, _src, _betaOf)                             \
+  do {                                                                   \
+    const uint8_t _beta = _betaOf(_src.alpha);                           \
+    int _r = _src.red, _g = _src.green, _b = _src.blue;                  \
+    if (_dst.alpha == 0) {                                               \
+      _dst.alpha = _beta;                                                \
+    } else {                                                             \
+      if (_dst.alpha < _beta) {                                          \
+        _dst.alpha = _beta;                                              \
+      }                                                                  \
+      if (_beta != 255) {                                                \
+        _r = DIV255(_r * _beta);                                         \
+        _g = DIV255(_g * _beta);                                         \
+        _b = DIV255(_b * _beta);                                         \
+      }                                                                  \
+    }                                                                    \
+    _dst.red   = MIN(255, _dst.red   + _r);                              \
+    _dst.green = MIN(255, _dst.green + _g);                              \
+    _dst.blue  = MIN(255, _dst.blue  + _b);                              \
+  } while (false)
+
+#define BLEND_PIXEL_SUB(_dst, _src, _betaOf)                             \
+  do {                                                                   \
+    const uint8_t _beta = _betaOf(_src.alpha);                           \
+    int _r = _src.red, _g = _src.green, _b = _src.blue;                  \
+    if (_dst.alpha == 0) {                                               \
+      _dst.alpha = _beta;                                                \
+    } else {                                                             \
+      if (_dst.alpha < _beta) {                                          \
+        _dst.alpha = _beta;                                              \
+      }                                                                  \
+      if (_beta != 255) {                                                \
+        _r = DIV255(_r * _beta);                                         \
+        _g = DIV255(_g * _beta);                                         \
+        _b = DIV255(_b * _beta);                                         \
+      }                                                                  \
+    }                                                                    \
+    _dst.red   = MAX(0, _dst.red   - _r);                                \
+    _dst.green = MAX(0, _dst.green - _g);                                \
+    _dst.blue  = MAX(0, _dst.blue  - _b);                                \
+  } while (false)
+
+#define BLEND_ROW(_blend, _beta)                                         \
+  LOOP({                                                                 \
+      _blend(dst->color, src->color, _beta);                             \
+      src++;                                                             \
+      dst++;                                                             \
+    }, width)
+
 static void
 RenderTexture(const Texture* srcTexture, const Texture* dstTexture,
               int srcX, int srcY, int srcWidth, int srcHeight, int dstX, int dstY,
@@ -1295,14 +1911,36 @@ RenderTexture(const Texture* srcTexture, const Texture* dstTexture,
   }
   const int width  = MIN(srcWidth,  dstTextureWidth - dstX);
   const int height = MIN(srcHeight, dstTextureHeight - dstY);
-  const Pixel* src = &(srcTexture->pixels[srcX + srcY * srcTextureWidth]);
-  Pixel* dst       = &(dstTexture->pixels[dstX + dstY * dstTextureWidth]);
-  const int srcPadding = srcTextureWidth - width;
-  const int dstPadding = dstTextureWidth - width;
-  switch (blendType) {
-  case BLEND_TYPE_ALPHA:
-    if (alpha == 255) {
-      for (int j = 0; j < height; j++, src += srcPadding, dst += dstPadding) {
+  if (blendType == BLEND_TYPE_ALPHA && alpha == 0) {
+    return;
+  }
+  const Pixel* srcRow = &(srcTexture->pixels[srcX + srcY * srcTexture->pitch]);
+  Pixel* dstRow       = &(dstTexture->pixels[dstX + dstY * dstTexture->pitch]);
+  int srcPitch = srcTexture->pitch;
+  int dstPitch = dstTexture->pitch;
+  const ScratchMark scratchMark = strb_GetScratchMark();
+  Pixel* rowBuffer = NULL;
+  if (SharesPixels(srcTexture, dstTexture) && srcRow < dstRow) {
+    // Walk the rows upward so that no source row is overwritten before
+    // it is read; a row overlapping itself is read from a copy
+    srcRow += (height - 1) * srcPitch;
+    dstRow += (height - 1) * dstPitch;
+    srcPitch = -srcPitch;
+    dstPitch = -dstPitch;
+    if (dstRow < srcRow + width) {
+      rowBuffer = strb_AllocScratch(sizeof(Pixel) * width);
+    }
+  }
+  for (int j = 0; j < height; j++, srcRow += srcPitch, dstRow += dstPitch) {
+    const Pixel* src = srcRow;
+    Pixel* dst = dstRow;
+    if (rowBuffer && blendType != BLEND_TYPE_NONE) {
+      MEMCPY(rowBuffer, srcRow, Pixel, width);
+      src = rowBuffer;
+    }
+    switch (blendType) {
+    case BLEND_TYPE_ALPHA:
+      if (alpha == 255) {
         LOOP({
             const uint8_t beta = src->color.alpha;
             const uint8_t dstAlpha = dst->color.alpha;
@@ -1322,9 +1960,7 @@ RenderTexture(const Texture* srcTexture, const Texture* dstTexture,
             src++;
             dst++;
           }, width);
-      }
-    } else if (0 < alpha) {
-      for (int j = 0; j < height; j++, src += srcPadding, dst += dstPadding) {
+      } else {
         LOOP({
             const uint8_t dstAlpha = dst->color.alpha;
             const uint8_t beta = DIV255(src->color.alpha * alpha);
@@ -1348,23 +1984,224 @@ RenderTexture(const Texture* srcTexture, const Texture* dstTexture,
             dst++;
           }, width);
       }
+      break;
+    case BLEND_TYPE_NONE:
+      MEMMOVE(dst, src, Pixel, width);
+      break;
+    case BLEND_TYPE_ADD:
+      if (alpha == 255) {
+        BLEND_ROW(BLEND_PIXEL_ADD, BETA_OPAQUE);
+      } else {
+        BLEND_ROW(BLEND_PIXEL_ADD, BETA_ALPHA);
+      }
+      break;
+    case BLEND_TYPE_SUB:
+      if (alpha == 255) {
+        BLEND_ROW(BLEND_PIXEL_SUB, BETA_OPAQUE);
+      } else {
+        BLEND_ROW(BLEND_PIXEL_SUB, BETA_ALPHA);
+      }
+      break;
+    case BLEND_TYPE_MASK:
+      BLEND_ROW(BLEND_PIXEL_MASK, BETA_OPAQUE);
+      break;
     }
-    break;
-  case BLEND_TYPE_NONE:
-    for (int j = 0; j < height; j++, src += srcPadding, dst += dstPadding) {
-      LOOP({
-          *dst = *src;
-          src++;
-          dst++;
-        }, width);
+  }
+  strb_ReleaseScratch(scratchMark);
+}
+
+/*
+ * Hue rotation in RGB, keeping the luminance (the same matrix as the
+ * hue-rotate filter of CSS). Rows are stored as 16.16 fixed point
+ * products so that a pixel needs only table lookups and additions.
+ * The table for the last angle is kept since sprites tend to be drawn
+ * with the same angle frame after frame.
+ */
+typedef struct {
+  bool isValid;
+  double angle;
+  int_fast32_t red[3][256];
+  int_fast32_t green[3][256];
+  int_fast32_t blue[3][256];
+} HueTable;
+
+static HueTable hueTable = {.isValid = false};
+
+static const HueTable*
+GetHueTable(double angle)
+{
+  if (hueTable.isValid && hueTable.angle == angle) {
+    return &hueTable;
+  }
+  const double c = cos(angle);
+  const double s = sin(angle);
+  const double matrix[3][3] = {
+    {0.213 + c * 0.787 - s * 0.213,
+     0.715 - c * 0.715 - s * 0.715,
+     0.072 - c * 0.072 + s * 0.928},
+    {0.213 - c * 0.213 + s * 0.143,
+     0.715 + c * 0.285 + s * 0.140,
+     0.072 - c * 0.072 - s * 0.283},
+    {0.213 - c * 0.213 - s * 0.787,
+     0.715 - c * 0.715 + s * 0.715,
+     0.072 + c * 0.928 + s * 0.072},
+  };
+  for (int k = 0; k < 3; k++) {
+    const int_fast32_t r16 = (int_fast32_t)(matrix[k][0] * (1 << 16));
+    const int_fast32_t g16 = (int_fast32_t)(matrix[k][1] * (1 << 16));
+    const int_fast32_t b16 = (int_fast32_t)(matrix[k][2] * (1 << 16));
+    for (int i = 0; i < 256; i++) {
+      hueTable.red[k][i]   = r16 * i;
+      hueTable.green[k][i] = g16 * i;
+      hueTable.blue[k][i]  = b16 * i;
     }
-    break;
-  default:
-    assert(false);
-    break;
+  }
+  hueTable.angle   = angle;
+  hueTable.isValid = true;
+  return &hueTable;
+}
+
+inline static uint8_t
+RotateHue(const HueTable* table, int k, uint8_t r, uint8_t g, uint8_t b)
+{
+  const int_fast32_t value =
+    table->red[k][r] + table->green[k][g] + table->blue[k][b] + (1 << 15);
+  return (value < 0) ? 0 : ((255 << 16) < value) ? 255 : (value >> 16);
+}
+
+/*
+ * The tone and the saturation only depend on each source channel, so
+ * they are looked up from tables built once per call. The tables are
+ * applied as a whole so that the pixel loop has no per-option branches.
+ */
+typedef struct {
+  const HueTable* hue;
+  bool hasColors;
+  int lumaMix[256];
+  int channelMix[256];
+  uint8_t toneRed[256];
+  uint8_t toneGreen[256];
+  uint8_t toneBlue[256];
+} ColorTables;
+
+/*
+ * Fills a 256-entry lookup table that applies the tone (-255 to 255) and then
+ * scales by the brightness (0 to 255, where 255 leaves the value as is).
+ */
+void
+strb_BuildToneTable(uint8_t* table, int tone, int brightness)
+{
+  for (int i = 0; i < 256; i++) {
+    int c = i;
+    if (0 < tone) {
+      c = ALPHA(255, c, tone);
+    } else if (tone < 0) {
+      c = ALPHA(0,   c, -tone);
+    }
+    table[i] = DIV255(c * brightness);
   }
 }
 
+static void
+BuildColorTables(ColorTables* tables, const RenderingTextureOptions* options)
+{
+  tables->hue = (options->hue != 0) ? GetHueTable(options->hue) : NULL;
+  const int saturation = options->saturation;
+  tables->hasColors =
+    tables->hue || saturation < 255 ||
+    options->toneRed || options->toneGreen || options->toneBlue;
+  if (!tables->hasColors) {
+    return;
+  }
+  // ALPHA(c, y, saturation) split into the terms of y and c; both tables
+  // are exact identities when the option is not given
+  for (int i = 0; i < 256; i++) {
+    tables->lumaMix[i]    = i * (255 - saturation);
+    tables->channelMix[i] = i * saturation;
+  }
+  strb_BuildToneTable(tables->toneRed,   options->toneRed,   255);
+  strb_BuildToneTable(tables->toneGreen, options->toneGreen, 255);
+  strb_BuildToneTable(tables->toneBlue,  options->toneBlue,  255);
+}
+
+/*
+ * The pixel loop of RenderTextureWithOptions is expanded once for each
+ * combination of the color conversion, the blend type and whether the
+ * global alpha is opaque, so that no invariant is tested per pixel.
+ */
+#define COLOR_AS_IS(c)
+
+#define COLOR_BY_TABLES(c)                                               \
+  do {                                                                   \
+    /* http://www.poynton.com/ColorFAQ.html */                           \
+    const uint8_t y =                                                    \
+      (6969 * c.red + 23434 * c.green + 2365 * c.blue) / 32768;          \
+    const int yMix = tables.lumaMix[y];                                  \
+    c.red   = DIV255(yMix + tables.channelMix[c.red]);                   \
+    c.green = DIV255(yMix + tables.channelMix[c.green]);                 \
+    c.blue  = DIV255(yMix + tables.channelMix[c.blue]);                  \
+    c.red   = tables.toneRed[c.red];                                     \
+    c.green = tables.toneGreen[c.green];                                 \
+    c.blue  = tables.toneBlue[c.blue];                                   \
+  } while (false)
+
+#define COLOR_BY_HUE_AND_TABLES(c)                                       \
+  do {                                                                   \
+    const uint8_t r0 = c.red, g0 = c.green, b0 = c.blue;                 \
+    c.red   = RotateHue(hue, 0, r0, g0, b0);                             \
+    c.green = RotateHue(hue, 1, r0, g0, b0);                             \
+    c.blue  = RotateHue(hue, 2, r0, g0, b0);                             \
+    COLOR_BY_TABLES(c);                                                  \
+  } while (false)
+
+#define TRANSFORM_PIXELS(_color, _blend, _beta)                          \
+  do {                                                                   \
+    for (int j = 0; j < dstHeight; j++) {                                \
+      int_fast32_t srcI16 = srcOX16 + j * srcDYX16;                      \
+      int_fast32_t srcJ16 = srcOY16 + j * srcDYY16;                      \
+      Pixel* dst = &(dstTexture->pixels[dstX0Int +                       \
+                                        (dstY0Int + j) *                 \
+                                        dstTexture->pitch]);             \
+      for (int i = 0; i < dstWidth;                                      \
+           i++, dst++, srcI16 += srcDXX16, srcJ16 += srcDXY16) {         \
+        const int_fast32_t srcI = srcI16 >> 16;                          \
+        const int_fast32_t srcJ = srcJ16 >> 16;                          \
+        if (srcX <= srcI && srcI < srcX2 &&                              \
+            srcY <= srcJ && srcJ < srcY2) {                              \
+          Color srcColor =                                               \
+            srcPixels[srcI + srcJ * srcTexturePitch + srcOffset].color;  \
+          _color(srcColor);                                              \
+          _blend(dst->color, srcColor, _beta);                           \
+        } else if ((srcI < srcX && srcDXX <= 0) ||                       \
+                   (srcX2 <= srcI && 0 <= srcDXX) ||                     \
+                   (srcJ < srcY && srcDXY <= 0) ||                       \
+                   (srcY2 <= srcJ && 0 <= srcDXY)) {                     \
+          break;                                                         \
+        }                                                                \
+      }                                                                  \
+    }                                                                    \
+  } while (false)
+
+#define RENDER_WITH_ALPHA(_color, _blend)                                \
+  do {                                                                   \
+    if (alpha == 255) {                                                  \
+      TRANSFORM_PIXELS(_color, _blend, BETA_OPAQUE);                     \
+    } else {                                                             \
+      TRANSFORM_PIXELS(_color, _blend, BETA_ALPHA);                      \
+    }                                                                    \
+  } while (false)
+
+#define RENDER_WITH_COLORS(_blend)                                       \
+  do {                                                                   \
+    if (!tables.hasColors) {                                             \
+      RENDER_WITH_ALPHA(COLOR_AS_IS, _blend);                            \
+    } else if (!hue) {                                                   \
+      RENDER_WITH_ALPHA(COLOR_BY_TABLES, _blend);                        \
+    } else {                                                             \
+      RENDER_WITH_ALPHA(COLOR_BY_HUE_AND_TABLES, _blend);                \
+    }                                                                    \
+  } while (false)
+
 static void
 RenderTextureWithOptions(const Texture* srcTexture, const Texture* dstTexture,
                          int srcX, int srcY, int srcWidth, int srcHeight, int dstX, int dstY,
@@ -1473,180 +2310,48 @@ RenderTextureWithOptions(const Texture* srcTexture, const Texture* dstTexture,
   const int_fast32_t srcDYX16 = (int_fast32_t)(srcDYX * (1 << 16));
   const int_fast32_t srcDYY16 = (int_fast32_t)(srcDYY * (1 << 16));
 
-  Texture* clonedTexture = NULL;
-  if (srcTexture == dstTexture) {
-    clonedTexture = ALLOC(Texture);
-    clonedTexture->pixels      = NULL;
-    clonedTexture->paletteSize = 0;
-    clonedTexture->palette     = NULL;
-    clonedTexture->indexes     = NULL;
-    clonedTexture->width  = dstTexture->width;
-    clonedTexture->height = dstTexture->height;
-    const int length = dstTexture->width * dstTexture->height;
-    clonedTexture->pixels = ALLOC_N(Pixel, length);
-    MEMCPY(clonedTexture->pixels, dstTexture->pixels, Pixel, length);
-    if (dstTexture->palette) {
-      const int paletteSize = clonedTexture->paletteSize = dstTexture->paletteSize;
-      clonedTexture->palette = ALLOC_N(Color, paletteSize);
-      MEMCPY(clonedTexture->palette, dstTexture->palette, Color, paletteSize);
-      clonedTexture->indexes = ALLOC_N(uint8_t, length);
-      MEMCPY(clonedTexture->indexes, dstTexture->indexes, uint8_t, length);
+  // Only the source rectangle is copied when it may be overwritten
+  const ScratchMark scratchMark = strb_GetScratchMark();
+  const Pixel* srcPixels = srcTexture->pixels;
+  int srcTexturePitch = srcTexture->pitch;
+  int srcOffset = 0;
+  if (SharesPixels(srcTexture, dstTexture)) {
+    Pixel* rect = strb_AllocScratch(sizeof(Pixel) * srcWidth * srcHeight);
+    for (int j = 0; j < srcHeight; j++) {
+      MEMCPY(&(rect[j * srcWidth]),
+             &(srcPixels[srcX + (srcY + j) * srcTexturePitch]),
+             Pixel, srcWidth);
     }
-    srcTexture = clonedTexture;
+    srcPixels = rect;
+    srcTexturePitch = srcWidth;
+    srcOffset = -(srcX + srcY * srcWidth);
   }
 
   const int srcX2 = srcX + srcWidth;
   const int srcY2 = srcY + srcHeight;
-  const int srcTextureWidth = srcTexture->width;
   const uint8_t alpha       = options->alpha;
   const BlendType blendType = options->blendType;
-  const int saturation      = options->saturation;
-  const int toneRed         = options->toneRed;
-  const int toneGreen       = options->toneGreen;
-  const int toneBlue        = options->toneBlue;
-  for (int j = 0; j < dstHeight; j++) {
-    int_fast32_t srcI16 = srcOX16 + j * srcDYX16;
-    int_fast32_t srcJ16 = srcOY16 + j * srcDYY16;
-    Pixel* dst =
-      &(dstTexture->pixels[dstX0Int + (dstY0Int + j) * dstTextureWidth]);
-    for (int i = 0; i < dstWidth;
-         i++, dst++, srcI16 += srcDXX16, srcJ16 += srcDXY16) {
-      const int_fast32_t srcI = srcI16 >> 16;
-      const int_fast32_t srcJ = srcJ16 >> 16;
-      if (srcX <= srcI && srcI < srcX2 && srcY <= srcJ && srcJ < srcY2) {
-        const Color srcColor =
-          srcTexture->pixels[srcI + srcJ * srcTextureWidth].color;
-        if (blendType == BLEND_TYPE_MASK) {
-          dst->color.alpha = srcColor.red;
-        } else {
-          uint8_t srcRed   = srcColor.red;
-          uint8_t srcGreen = srcColor.green;
-          uint8_t srcBlue  = srcColor.blue;
-          uint8_t srcAlpha = srcColor.alpha;
-          if (saturation < 255) {
-            // http://www.poynton.com/ColorFAQ.html
-            const uint8_t y =
-              (6969 * srcRed + 23434 * srcGreen + 2365 * srcBlue) / 32768;
-            srcRed   = ALPHA(srcRed,   y, saturation);
-            srcGreen = ALPHA(srcGreen, y, saturation);
-            srcBlue  = ALPHA(srcBlue,  y, saturation);
-          }
-          if (toneRed) {
-            if (0 < toneRed) {
-              srcRed = ALPHA(255, srcRed, toneRed);
-            } else {
-              srcRed = ALPHA(0,   srcRed, -toneRed);
-            }
-          }
-          if (toneGreen) {
-            if (0 < toneGreen) {
-              srcGreen = ALPHA(255, srcGreen, toneGreen);
-            } else {
-              srcGreen = ALPHA(0,   srcGreen, -toneGreen);
-            }
-          }
-          if (toneBlue) {
-            if (0 < toneBlue) {
-              srcBlue = ALPHA(255, srcBlue, toneBlue);
-            } else {
-              srcBlue = ALPHA(0,   srcBlue, -toneBlue);
-            }
-          }
-          if (blendType == BLEND_TYPE_NONE) {
-            dst->color.red   = srcRed;
-            dst->color.green = srcGreen;
-            dst->color.blue  = srcBlue;
-            dst->color.alpha = srcAlpha;
-          } else if (dst->color.alpha == 0) {
-            const uint8_t beta = DIV255(srcAlpha * alpha);
-            switch (blendType) {
-            case BLEND_TYPE_ALPHA:
-              dst->color.red   = srcRed;
-              dst->color.green = srcGreen;
-              dst->color.blue  = srcBlue;
-              dst->color.alpha = beta;
-              break;
-            case BLEND_TYPE_ADD:
-              {
-                const int addR = srcRed   + dst->color.red;
-                const int addG = srcGreen + dst->color.green;
-                const int addB = srcBlue  + dst->color.blue;
-                dst->color.red   = MIN(255, addR);
-                dst->color.green = MIN(255, addG);
-                dst->color.blue  = MIN(255, addB);
-                dst->color.alpha = beta;
-              }
-              break;
-            case BLEND_TYPE_SUB:
-              {
-                const int subR = -srcRed   + dst->color.red;
-                const int subG = -srcGreen + dst->color.green;
-                const int subB = -srcBlue  + dst->color.blue;
-                dst->color.red   = MAX(0, subR);
-                dst->color.green = MAX(0, subG);
-                dst->color.blue  = MAX(0, subB);
-                dst->color.alpha = beta;
-              }
-              break;
-            case BLEND_TYPE_MASK:
-              assert(false);
-              break;
-            case BLEND_TYPE_NONE:
-              assert(false);
-              break;
-            }
-          } else {
-            const uint8_t beta = DIV255(srcAlpha * alpha);
-            if (dst->color.alpha < beta) {
-              dst->color.alpha = beta;
-            }
-            switch (blendType) {
-            case BLEND_TYPE_ALPHA:
-              dst->color.red   = ALPHA(srcRed,   dst->color.red,   beta);
-              dst->color.green = ALPHA(srcGreen, dst->color.green, beta);
-              dst->color.blue  = ALPHA(srcBlue,  dst->color.blue,  beta);
-              break;
-            case BLEND_TYPE_ADD:
-              {
-                const int addR = DIV255(srcRed   * beta) + dst->color.red;
-                const int addG = DIV255(srcGreen * beta) + dst->color.green;
-                const int addB = DIV255(srcBlue  * beta) + dst->color.blue;
-                dst->color.red   = MIN(255, addR);
-                dst->color.green = MIN(255, addG);
-                dst->color.blue  = MIN(255, addB);
-              }
-              break;
-            case BLEND_TYPE_SUB:
-              {
-                const int subR = -DIV255(srcRed   * beta) + dst->color.red;
-                const int subG = -DIV255(srcGreen * beta) + dst->color.green;
-                const int subB = -DIV255(srcBlue  * beta) + dst->color.blue;
-                dst->color.red   = MAX(0, subR);
-                dst->color.green = MAX(0, subG);
-                dst->color.blue  = MAX(0, subB);
-              }
-              break;
-            case BLEND_TYPE_MASK:
-              assert(false);
-              break;
-            case BLEND_TYPE_NONE:
-              assert(false);
-              break;
-            }
-          }
-        }
-      } else if ((srcI < srcX && srcDXX <= 0) ||
-                 (srcX2 <= srcI && 0 <= srcDXX) ||
-                 (srcJ < srcY && srcDXY <= 0) ||
-                 (srcY2 <= srcJ && 0 <= srcDXY)) {
-        break;
-      }
-    }
-  }
-  if (clonedTexture) {
-    Texture_free(clonedTexture);
-    clonedTexture = NULL;
+  ColorTables tables;
+  BuildColorTables(&tables, options);
+  const HueTable* hue = tables.hue;
+  switch (blendType) {
+  case BLEND_TYPE_NONE:
+    RENDER_WITH_COLORS(BLEND_PIXEL_NONE);
+    break;
+  case BLEND_TYPE_ALPHA:
+    RENDER_WITH_COLORS(BLEND_PIXEL_ALPHA);
+    break;
+  case BLEND_TYPE_ADD:
+    RENDER_WITH_COLORS(BLEND_PIXEL_ADD);
+    break;
+  case BLEND_TYPE_SUB:
+    RENDER_WITH_COLORS(BLEND_PIXEL_SUB);
+    break;
+  case BLEND_TYPE_MASK:
+    TRANSFORM_PIXELS(COLOR_AS_IS, BLEND_PIXEL_MASK, BETA_OPAQUE);
+    break;
   }
+  strb_ReleaseScratch(scratchMark);
 }
 
 static VALUE
@@ -1657,6 +2362,7 @@ Texture_render_texture(int argc, VALUE* argv, VALUE self)
   Data_Get_Struct(self, Texture, dstTexture);
   strb_CheckDisposedTexture(dstTexture);
   CheckPalette(dstTexture);
+  CheckAlphaOnly(dstTexture);
 
   volatile VALUE rbTexture, rbX, rbY, rbOptions;
   if (3 <= argc && argc <= 4) {
@@ -1699,6 +2405,8 @@ Texture_render_texture(int argc, VALUE* argv, VALUE self)
     .toneGreen    = 0,
     .toneBlue     = 0,
     .saturation   = 255,
+    .hue          = 0,
+    .color        = (Color){.red = 255, .green = 255, .blue = 255, .alpha = 255},
   };
   if (!SPECIAL_CONST_P(rbOptions) && BUILTIN_TYPE(rbOptions) == T_HASH) {
     if (NIL_P(RHASH_IFNONE(rbOptions))) {
@@ -1778,6 +2486,12 @@ Texture_render_texture(int argc, VALUE* argv, VALUE self)
       if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_saturation))) {
         options.saturation = NUM2INT(val);
       }
+      if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_hue))) {
+        options.hue = NUM2DBL(val);
+      }
+      if (!NIL_P(val = rb_hash_aref(rbOptions, symbol_color))) {
+        strb_GetColorFromRubyValue(&(options.color), val);
+      }
     }
   } else if (!NIL_P(rbOptions)) {
     rb_raise(rb_eTypeError, "wrong argument type %s (expected Hash)",
@@ -1804,11 +2518,67 @@ Texture_render_texture(int argc, VALUE* argv, VALUE self)
                            &(srcX), &(srcY), &(srcWidth), &(srcHeight))) {
     return self;
   }
-  if (srcTexture != dstTexture &&
-      (matrix->a == 1 && matrix->b == 0 && matrix->c == 0 && matrix->d == 1) &&
-      (options.scaleX == 1 && options.scaleY == 1 && options.angle == 0 &&
-       toneRed == 0 && toneGreen == 0 && toneBlue == 0 && saturation == 255 && 
-       (options.blendType == BLEND_TYPE_ALPHA || options.blendType == BLEND_TYPE_NONE))) {
+  const bool isUntransformed =
+    (matrix->a == 1 && matrix->b == 0 && matrix->c == 0 && matrix->d == 1) &&
+    (options.scaleX == 1 && options.scaleY == 1 && options.angle == 0 &&
+     toneRed == 0 && toneGreen == 0 && toneBlue == 0 && saturation == 255 &&
+     options.hue == 0);
+  const ScratchMark scratchMark = strb_GetScratchMark();
+  Texture tintedTexture;
+  const Color color = options.color;
+  const bool isTinted =
+    color.red < 255 || color.green < 255 || color.blue < 255 ||
+    color.alpha < 255;
+  if (srcTexture->alphas &&
+      isUntransformed &&
+      (options.blendType == BLEND_TYPE_ALPHA ||
+       options.blendType == BLEND_TYPE_MASK)) {
+    RenderCoverage(srcTexture->alphas, srcTexture->pitch,
+                   srcX, srcY, srcWidth, srcHeight, dstTexture,
+                   NUM2INT(rbX), NUM2INT(rbY),
+                   color, options.alpha, options.blendType);
+    return self;
+  }
+  if (srcTexture->alphas || isTinted) {
+    // Other cases render a copy of the source rect multiplied by the color;
+    // alpha-only sources are read as white with the stored alpha
+    tintedTexture = (Texture){
+      .width    = srcWidth,
+      .height   = srcHeight,
+      .pitch    = srcWidth,
+      .rbParent = Qnil,
+    };
+    tintedTexture.pixels =
+      strb_AllocScratch(sizeof(Pixel) * srcWidth * srcHeight);
+    for (int j = 0; j < srcHeight; j++) {
+      Pixel* dst = &(tintedTexture.pixels[j * srcWidth]);
+      if (!srcTexture->alphas) {
+        const Pixel* src =
+          &(srcTexture->pixels[srcX + (srcY + j) * srcTexture->pitch]);
+        for (int i = 0; i < srcWidth; i++, src++, dst++) {
+          dst->color.red   = DIV255(src->color.red   * color.red);
+          dst->color.green = DIV255(src->color.green * color.green);
+          dst->color.blue  = DIV255(src->color.blue  * color.blue);
+          dst->color.alpha = DIV255(src->color.alpha * color.alpha);
+        }
+        continue;
+      }
+      const uint8_t* src =
+        &(srcTexture->alphas[srcX + (srcY + j) * srcTexture->pitch]);
+      for (int i = 0; i < srcWidth; i++, src++, dst++) {
+        dst->color = color;
+        if (options.blendType == BLEND_TYPE_MASK) {
+          // The mask value is read from the red channel
+          dst->color.red = *src;
+        }
+        dst->color.alpha = DIV255(*src * color.alpha);
+      }
+    }
+    srcTexture = &tintedTexture;
+    srcX = 0;
+    srcY = 0;
+  }
+  if (isUntransformed) {
     RenderTexture(srcTexture, dstTexture,
                   srcX, srcY, srcWidth, srcHeight, NUM2INT(rbX), NUM2INT(rbY),
                   options.alpha, options.blendType);
@@ -1817,6 +2587,7 @@ Texture_render_texture(int argc, VALUE* argv, VALUE self)
                              srcX, srcY, srcWidth, srcHeight, NUM2INT(rbX), NUM2INT(rbY),
                              &options);
   }
+  strb_ReleaseScratch(scratchMark);
   return self;
 }
 
@@ -1826,6 +2597,7 @@ Texture_save(VALUE self, VALUE rbPath)
   const Texture* texture;
   Data_Get_Struct(self, Texture, texture);
   strb_CheckDisposedTexture(texture);
+  CheckAlphaOnly(texture);
   const char* path = StringValueCStr(rbPath);
   FILE* fp = fopen(path, "wb");
   if (!fp) {
@@ -1842,7 +2614,7 @@ Texture_save(VALUE self, VALUE rbPath)
   for (int j = 0; j < texture->height; j++) {
     png_byte row[texture->width * 4];
     for (int i = 0; i < texture->width; i++) {
-      const Color* c = &(texture->pixels[texture->width * j + i].color);
+      const Color* c = &(texture->pixels[texture->pitch * j + i].color);
       png_byte* const r = &(row[i * 4]);
       r[0] = c->red;
       r[1] = c->green;
@@ -1857,6 +2629,97 @@ Texture_save(VALUE self, VALUE rbPath)
   return Qnil;
 }
 
+static VALUE
+Texture_scroll_bang(int argc, VALUE* argv, VALUE self)
+{
+  rb_check_frozen(self);
+  const Texture* texture;
+  Data_Get_Struct(self, Texture, texture);
+  strb_CheckDisposedTexture(texture);
+  CheckAlphaOnly(texture);
+  CheckPalette(texture);
+  volatile VALUE rbDx, rbDy, rbOptions;
+  rb_scan_args(argc, argv, "21", &rbDx, &rbDy, &rbOptions);
+  if (NIL_P(rbOptions)) {
+    rbOptions = rb_hash_new();
+  } else {
+    Check_Type(rbOptions, T_HASH);
+  }
+  const int dx = NUM2INT(rbDx);
+  const int dy = NUM2INT(rbDy);
+  volatile VALUE rbFill = rb_hash_aref(rbOptions, symbol_fill);
+  Color fillColor;
+  if (!NIL_P(rbFill)) {
+    strb_GetColorFromRubyValue(&fillColor, rbFill);
+  }
+
+  const int width  = texture->width;
+  const int height = texture->height;
+  const int absDx = (dx < 0) ? -dx : dx;
+  const int absDy = (dy < 0) ? -dy : dy;
+  // Exposed rects: one horizontal strip and one vertical strip beside it
+  int rects[2][4];
+  int rectCount = 0;
+  if (width <= absDx || height <= absDy) {
+    if (dx || dy) {
+      rects[0][0] = 0;
+      rects[0][1] = 0;
+      rects[0][2] = width;
+      rects[0][3] = height;
+      rectCount = 1;
+    }
+  } else {
+    const int rowWidth  = width - absDx;
+    const int rowHeight = height - absDy;
+    const int srcX = (dx < 0) ? absDx : 0;
+    const int dstX = (0 < dx) ? dx : 0;
+    if (0 < dy) {
+      for (int j = height - 1; dy <= j; j--) {
+        MEMMOVE(&(texture->pixels[dstX + j * texture->pitch]),
+                &(texture->pixels[srcX + (j - dy) * texture->pitch]),
+                Pixel, rowWidth);
+      }
+    } else if (dx || dy) {
+      for (int j = 0; j < rowHeight; j++) {
+        MEMMOVE(&(texture->pixels[dstX + j * texture->pitch]),
+                &(texture->pixels[srcX + (j + absDy) * texture->pitch]),
+                Pixel, rowWidth);
+      }
+    }
+    if (dy) {
+      rects[rectCount][0] = 0;
+      rects[rectCount][1] = (0 < dy) ? 0 : rowHeight;
+      rects[rectCount][2] = width;
+      rects[rectCount][3] = absDy;
+      rectCount++;
+    }
+    if (dx) {
+      rects[rectCount][0] = (0 < dx) ? 0 : rowWidth;
+      rects[rectCount][1] = (0 < dy) ? dy : 0;
+      rects[rectCount][2] = absDx;
+      rects[rectCount][3] = rowHeight;
+      rectCount++;
+    }
+  }
+
+  volatile VALUE rbRects = rb_ary_new2(rectCount);
+  for (int k = 0; k < rectCount; k++) {
+    if (!NIL_P(rbFill)) {
+      FillRect(texture, rects[k][0], rects[k][1], rects[k][2], rects[k][3],
+               fillColor);
+    }
+    volatile VALUE rbRect = rb_ary_new3(4,
+                                        INT2NUM(rects[k][0]),
+                                        INT2NUM(rects[k][1]),
+                                        INT2NUM(rects[k][2]),
+                                        INT2NUM(rects[k][3]));
+    OBJ_FREEZE(rbRect);
+    rb_ary_push(rbRects, rbRect);
+  }
+  OBJ_FREEZE(rbRects);
+  return rbRects;
+}
+
 static VALUE
 Texture_size(VALUE self)
 {
@@ -1936,6 +2799,7 @@ Texture_undump(VALUE self, VALUE rbData, VALUE rbFormat)
   const Texture* texture;
   Data_Get_Struct(self, Texture, texture);
   strb_CheckDisposedTexture(texture);
+  CheckAlphaOnly(texture);
   CheckPalette(texture);
   const char* format = StringValuePtr(rbFormat);
   const int formatLength = RSTRING_LEN(rbFormat);
@@ -1947,19 +2811,61 @@ Texture_undump(VALUE self, VALUE rbData, VALUE rbFormat)
   }
   const uint8_t* data = (uint8_t*)RSTRING_PTR(rbData);
   Pixel* pixels = texture->pixels;
-  for (int i = 0; i < pixelLength; i++, pixels++) {
-    for (int j = 0; j < formatLength; j++, data++) {
-      switch (format[j]) {
-      case 'r': pixels->color.red   = *data; break;
-      case 'g': pixels->color.green = *data; break;
-      case 'b': pixels->color.blue  = *data; break;
-      case 'a': pixels->color.alpha = *data; break;
+  const int padding = texture->pitch - texture->width;
+  for (int j = 0; j < texture->height; j++, pixels += padding) {
+    for (int i = 0; i < texture->width; i++, pixels++) {
+      for (int k = 0; k < formatLength; k++, data++) {
+        switch (format[k]) {
+        case 'r': pixels->color.red   = *data; break;
+        case 'g': pixels->color.green = *data; break;
+        case 'b': pixels->color.blue  = *data; break;
+        case 'a': pixels->color.alpha = *data; break;
+        }
       }
     }
   }
   return self;
 }
 
+static VALUE
+Texture_view(VALUE self, VALUE rbX, VALUE rbY, VALUE rbWidth, VALUE rbHeight)
+{
+  const Texture* texture;
+  Data_Get_Struct(self, Texture, texture);
+  strb_CheckDisposedTexture(texture);
+  CheckAlphaOnly(texture);
+  if (texture->palette) {
+    rb_raise(strb_GetStarRubyErrorClass(),
+             "can't create a view of a texture with a palette");
+  }
+  if (strb_IsFlippedScreen(NIL_P(texture->rbParent) ?
+                          self : texture->rbParent)) {
+    rb_raise(strb_GetStarRubyErrorClass(),
+             "can't create a view of the screen with the present thread");
+  }
+  const int x      = NUM2INT(rbX);
+  const int y      = NUM2INT(rbY);
+  const int width  = NUM2INT(rbWidth);
+  const int height = NUM2INT(rbHeight);
+  if (x < 0 || y < 0 || width <= 0 || height <= 0 ||
+      texture->width < x + width || texture->height < y + height) {
+    rb_raise(rb_eArgError, "invalid view rect: (%d, %d, %d, %d)",
+             x, y, width, height);
+  }
+  volatile VALUE rbView = rb_obj_alloc(rb_obj_class(self));
+  Texture* view;
+  Data_Get_Struct(rbView, Texture, view);
+  view->width    = width;
+  view->height   = height;
+  view->pitch    = texture->pitch;
+  view->pixels   = &(texture->pixels[x + y * texture->pitch]);
+  view->rbParent = NIL_P(texture->rbParent) ? self : texture->rbParent;
+  if (OBJ_FROZEN(self)) {
+    OBJ_FREEZE(rbView);
+  }
+  return rbView;
+}
+
 static VALUE
 Texture_width(VALUE self)
 {
@@ -1975,13 +2881,15 @@ strb_InitializeTexture(VALUE rb_mStarRuby)
   rb_cTexture = rb_define_class_under(rb_mStarRuby, "Texture", rb_cObject);
   rb_define_singleton_method(rb_cTexture, "load", Texture_s_load, -1);
   rb_define_alloc_func(rb_cTexture, Texture_alloc);
-  rb_define_private_method(rb_cTexture, "initialize", Texture_initialize, 2);
+  rb_define_private_method(rb_cTexture, "initialize", Texture_initialize, -1);
   rb_define_private_method(rb_cTexture, "initialize_copy",
                            Texture_initialize_copy, 1);
   rb_define_method(rb_cTexture, "[]",
                    Texture_aref, 2);
   rb_define_method(rb_cTexture, "[]=",
                    Texture_aset, 3);
+  rb_define_method(rb_cTexture, "alpha_only?",
+                   Texture_alpha_only, 0);
   rb_define_method(rb_cTexture, "change_hue",
                    Texture_change_hue, 1);
   rb_define_method(rb_cTexture, "change_hue!",
@@ -2016,22 +2924,30 @@ strb_InitializeTexture(VALUE rb_mStarRuby)
                    Texture_render_rect, 5);
   rb_define_method(rb_cTexture, "render_text",
                    Texture_render_text, -1);
+  rb_define_method(rb_cTexture, "render_text_block",
+                   Texture_render_text_block, -1);
   rb_define_method(rb_cTexture, "render_texture",
                    Texture_render_texture, -1);
   rb_define_method(rb_cTexture, "save",
                    Texture_save, 1);
+  rb_define_method(rb_cTexture, "scroll!",
+                   Texture_scroll_bang, -1);
   rb_define_method(rb_cTexture, "size",
                    Texture_size, 0);
   rb_define_method(rb_cTexture, "transform_in_perspective",
                    Texture_transform_in_perspective, -1);
   rb_define_method(rb_cTexture, "undump",
                    Texture_undump, 2);
+  rb_define_method(rb_cTexture, "view",
+                   Texture_view, 4);
   rb_define_method(rb_cTexture, "width",
                    Texture_width, 0);
 
   symbol_add            = ID2SYM(rb_intern("add"));
   symbol_alpha          = ID2SYM(rb_intern("alpha"));
+  symbol_alpha_only     = ID2SYM(rb_intern("alpha_only"));
   symbol_angle          = ID2SYM(rb_intern("angle"));
+  symbol_anti_alias     = ID2SYM(rb_intern("anti_alias"));
   symbol_background     = ID2SYM(rb_intern("background"));
   symbol_blend_type     = ID2SYM(rb_intern("blend_type"));
   symbol_blur           = ID2SYM(rb_intern("blur"));
@@ -2043,7 +2959,10 @@ strb_InitializeTexture(VALUE rb_mStarRuby)
   symbol_camera_yaw     = ID2SYM(rb_intern("camera_yaw"));
   symbol_center_x       = ID2SYM(rb_intern("center_x"));
   symbol_center_y       = ID2SYM(rb_intern("center_y"));
+  symbol_color          = ID2SYM(rb_intern("color"));
+  symbol_fill           = ID2SYM(rb_intern("fill"));
   symbol_height         = ID2SYM(rb_intern("height"));
+  symbol_hue            = ID2SYM(rb_intern("hue"));
   symbol_intersection_x = ID2SYM(rb_intern("intersection_x"));
   symbol_intersection_y = ID2SYM(rb_intern("intersection_y"));
   symbol_io_length      = ID2SYM(rb_intern("io_length"));
@@ -2051,10 +2970,12 @@ strb_InitializeTexture(VALUE rb_mStarRuby)
   symbol_mask           = ID2SYM(rb_intern("mask"));
   symbol_matrix         = ID2SYM(rb_intern("matrix"));
   symbol_none           = ID2SYM(rb_intern("none"));
+  symbol_outline        = ID2SYM(rb_intern("outline"));
   symbol_palette        = ID2SYM(rb_intern("palette"));
   symbol_saturation     = ID2SYM(rb_intern("saturation"));
   symbol_scale_x        = ID2SYM(rb_intern("scale_x"));
   symbol_scale_y        = ID2SYM(rb_intern("scale_y"));
+  symbol_shadow         = ID2SYM(rb_intern("shadow"));
   symbol_src_height     = ID2SYM(rb_intern("src_height"));
   symbol_src_width      = ID2SYM(rb_intern("src_width"));
   symbol_src_x          = ID2SYM(rb_intern("src_x"));
@@ -105,6 +105,245 @@ class TestAudio < Test::Unit::TestCase
     end
   end
 
+  def test_sound_effect
+    se = Audio::SoundEffect.load("sounds/sample")
+    assert se.equal?(Audio::SoundEffect.load("sounds/sample"))
+    assert_match(/sample\.wav\z/, se.path)
+    assert se.path.frozen?
+    ses = Audio.preload("sounds/sample", ["sounds/sample2"])
+    assert ses.frozen?
+    assert_equal 2, ses.size
+    assert ses[0].equal?(se)
+    assert_match(/sample2\.wav\z/, ses[1].path)
+    se.play
+    se.play(:volume => 128, :panning => -128, :time => 0)
+    Audio.stop_all_ses
+    assert_raise ArgumentError do
+      se.play(:volume => 256)
+    end
+    assert_raise ArgumentError do
+      se.play(:panning => 256)
+    end
+    assert_raise TypeError do
+      se.play(false)
+    end
+    assert_raise Errno::ENOENT do
+      Audio::SoundEffect.load("sounds/not_exist")
+    end
+    assert_raise TypeError do
+      Audio.preload(nil)
+    end
+  end
+
+  def test_chunk_cache
+    limit = Audio.chunk_cache_limit
+    begin
+      stats = Audio.chunk_cache_stats
+      assert stats.frozen?
+      se = Audio::SoundEffect.load("sounds/sample2")
+      se.play
+      Audio.stop_all_ses
+      if se.loaded?
+        assert 0 < se.bytes
+        assert se.bytes <= Audio.chunk_cache_stats[:bytes]
+        Audio.chunk_cache_limit = 0
+        assert_equal false, se.loaded?
+        assert_equal 0, se.bytes
+        assert_equal 0, Audio.chunk_cache_stats[:bytes]
+        assert stats[:evictions] < Audio.chunk_cache_stats[:evictions]
+        Audio.chunk_cache_limit = limit
+        misses = Audio.chunk_cache_stats[:misses]
+        se.play
+        assert_equal misses + 1, Audio.chunk_cache_stats[:misses]
+        assert se.loaded?
+        Audio.stop_all_ses
+      else
+        assert_equal 0, se.bytes
+      end
+      assert_raise ArgumentError do
+        Audio.chunk_cache_limit = -1
+      end
+    ensure
+      Audio.chunk_cache_limit = limit
+    end
+  end
+
+  def test_voice_pool
+    count = Audio.se_channel_count
+    assert_equal Audio::MAX_SE_COUNT, count
+    begin
+      Audio.se_channel_count = 1
+      assert_equal 1, Audio.se_channel_count
+      stats = Audio.voice_stats
+      assert stats.frozen?
+      assert_equal 1, stats[:channels]
+      se1, se2 = Audio.preload("sounds/sample", "sounds/sample2")
+      se1.play(:priority => 1)
+      if se1.loaded?
+        se1.play(:volume => 128)
+        assert_equal stats[:coalesced] + 1, Audio.voice_stats[:coalesced]
+        assert_equal 1, Audio.playing_se_count
+        se2.play(:priority => 0)
+        assert_equal stats[:dropped] + 1, Audio.voice_stats[:dropped]
+        se2.play(:priority => 1)
+        assert_equal stats[:stolen] + 1, Audio.voice_stats[:stolen]
+        assert_equal 1, Audio.playing_se_count
+      end
+      assert_raise TypeError do
+        se1.play(:priority => false)
+      end
+      assert_raise ArgumentError do
+        Audio.se_channel_count = 0
+      end
+      assert_raise ArgumentError do
+        Audio.se_channel_count = 257
+      end
+    ensure
+      Audio.stop_all_ses
+      Audio.se_channel_count = count
+    end
+    assert_equal count, Audio.voice_stats[:channels]
+  end
+
+  def test_open
+    frequency = Audio.frequency
+    buffer_size = Audio.buffer_size
+    assert_kind_of Integer, frequency
+    assert_equal 1024, buffer_size
+    if Audio.enabled?
+      begin
+        se = Audio::SoundEffect.load("sounds/sample")
+        se.play
+        Audio.open(:frequency => 44100, :buffer_size => 512)
+        assert Audio.enabled?
+        assert_equal 512, Audio.buffer_size
+        assert_equal false, se.loaded?
+        se.play
+        assert se.loaded?
+        Audio.play_bgm("sounds/music")
+        Audio.stop_bgm
+      ensure
+        Audio.open(:frequency => frequency, :buffer_size => buffer_size)
+      end
+      assert_equal buffer_size, Audio.buffer_size
+    else
+      assert_raise StarRubyError do
+        Audio.open
+      end
+    end
+    assert_raise ArgumentError do
+      Audio.open(:buffer_size => 1000)
+    end
+    assert_raise ArgumentError do
+      Audio.open(:frequency => 0)
+    end
+    assert_raise TypeError do
+      Audio.open(false)
+    end
+  end
+
+  def test_stream
+    stream = Audio::Stream.new(:buffer_size => 1000)
+    assert_equal 1024, stream.buffer_size
+    assert_equal 255, stream.volume
+    assert_equal false, stream.playing?
+    assert_equal 0, stream.queued_frames
+    data = [1000, -1000].pack("s*") * 2000
+    assert_equal 1024, stream.write(data)
+    assert_equal 1024, stream.queued_frames
+    assert_equal 0, stream.write(data)
+    stream.volume = 128
+    assert_equal 128, stream.volume
+    stream.play
+    assert stream.playing?
+    if Audio.enabled?
+      100.times do
+        break if stream.queued_frames == 0 and 0 < stream.underruns
+        sleep 0.02
+      end
+      assert_equal 0, stream.queued_frames
+      assert 0 < stream.underruns
+      assert 0 < stream.underrun_frames
+      assert_equal 1024, stream.write(data)
+    end
+    stream.stop
+    assert_equal false, stream.playing?
+    assert_equal 0, Audio::Stream.new.write("")
+    assert_raise ArgumentError do
+      stream.write("abc")
+    end
+    assert_raise TypeError do
+      stream.write(nil)
+    end
+    assert_raise ArgumentError do
+      stream.volume = 256
+    end
+    assert_raise ArgumentError do
+      Audio::Stream.new(:buffer_size => 0)
+    end
+    assert_raise TypeError do
+      Audio::Stream.new(false)
+    end
+  end
+
+  def test_offline
+    driver = Audio.driver
+    frequency = Audio.frequency
+    buffer_size = Audio.buffer_size
+    assert_equal :default, driver
+    begin
+      begin
+        Audio.open(:driver => :offline, :frequency => 22050,
+                   :buffer_size => 512)
+      rescue StarRubyError
+        assert_raise StarRubyError do
+          Audio.render(100)
+        end
+        return
+      end
+      assert_equal :offline, Audio.driver
+      stream = Audio::Stream.new
+      stream.write([1000, -1000].pack("s*") * 100)
+      stream.play
+      data = Audio.render(100)
+      assert_equal 0, data.size % (512 * 4)
+      assert 22050 * 4 / 10 <= data.size
+      assert_equal [1000, -1000] * 100, data.unpack("s*")[0, 200]
+      assert_equal "", Audio.render(0)
+      Audio.play_bgm("sounds/music")
+      position = Audio.bgm_position
+      Audio.render(1000)
+      assert_in_delta 1000, Audio.bgm_position - position, 50
+      Audio.stop_bgm
+      path = "offline_test.wav"
+      begin
+        data = Audio.render(50, :path => path)
+        wav = File.binread(path)
+        assert_equal "RIFF", wav[0, 4]
+        assert_equal 44 + data.size, wav.size
+        assert_equal data, wav[44..-1]
+      ensure
+        File.delete(path) if File.exist?(path)
+      end
+      assert_raise ArgumentError do
+        Audio.render(-1)
+      end
+      assert_raise TypeError do
+        Audio.render(100, false)
+      end
+    ensure
+      Audio.open(:driver => driver, :frequency => frequency,
+                 :buffer_size => buffer_size) rescue nil
+    end
+    assert_equal driver, Audio.driver
+    assert_raise StarRubyError do
+      Audio.render(100)
+    end
+    assert_raise ArgumentError do
+      Audio.open(:driver => :foo)
+    end
+  end
+
   def test_max_se_count
     assert_equal 8, Audio::MAX_SE_COUNT
   end
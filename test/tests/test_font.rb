@@ -57,6 +57,35 @@ class TestFont < Test::Unit::TestCase
     end
   end
 
+  def test_index_cache_path
+    assert_nil Font.index_cache_path
+    path = "fonts/font_index.cache"
+    begin
+      Font.index_cache_path = path
+      assert_equal path, Font.index_cache_path
+      assert Font.index_cache_path.frozen?
+      exist = Font.exist?("FreeSans, Bold")
+      if RUBY_PLATFORM =~ /linux/
+        assert File.exist?(path)
+      end
+      Font.index_cache_path = path
+      assert_equal exist, Font.exist?("FreeSans, Bold")
+      assert_equal false, Font.exist?("FreeSans, NotStyle")
+      if File.exist?(path)
+        File.open(path, "wb") {|f| f.write("broken") }
+        Font.index_cache_path = path
+        assert_equal exist, Font.exist?("FreeSans, Bold")
+      end
+      assert_raise TypeError do
+        Font.index_cache_path = 1
+      end
+    ensure
+      Font.index_cache_path = nil
+      File.delete(path) if File.exist?(path)
+    end
+    assert_nil Font.index_cache_path
+  end
+
   def test_new
     if Font.exist?("Arial")
       font = Font.new("Arial", 16)
@@ -165,4 +194,90 @@ class TestFont < Test::Unit::TestCase
     end
   end
 
+  def test_glyph_cache
+    limit = Font.glyph_cache_limit
+    begin
+      font = Font.new("fonts/ORANGEKI", 12)
+      Font.glyph_cache_limit = 0
+      Font.glyph_cache_limit = 1024 * 1024
+      texture = Texture.new(100, 100)
+      color = Color.new(255, 255, 255)
+      stats = font.glyph_cache_stats
+      assert stats.frozen?
+      assert_equal 0, stats[:glyphs]
+      texture.render_text("xyzzy", 0, 0, font, color)
+      stats2 = font.glyph_cache_stats
+      assert_equal 3, stats2[:glyphs]
+      assert_equal 3, stats2[:misses] - stats[:misses]
+      assert_equal 2, stats2[:hits] - stats[:hits]
+      assert 0 < stats2[:bytes]
+      texture2 = Texture.new(100, 100)
+      texture2.render_text("xyzzy", 0, 0, font, color)
+      stats3 = font.glyph_cache_stats
+      assert_equal stats2[:misses], stats3[:misses]
+      assert_equal 5, stats3[:hits] - stats2[:hits]
+      assert_equal texture.dump("rgba"), texture2.dump("rgba")
+      Font.glyph_cache_limit = 0
+      assert_equal 0, Font.glyph_cache_limit
+      assert_equal 0, font.glyph_cache_stats[:glyphs]
+      assert_equal 0, font.glyph_cache_stats[:bytes]
+      texture3 = Texture.new(100, 100)
+      texture3.render_text("xyzzy", 0, 0, font, color)
+      assert_equal 1, font.glyph_cache_stats[:glyphs]
+      assert_equal texture.dump("rgba"), texture3.dump("rgba")
+      assert_raise ArgumentError do
+        Font.glyph_cache_limit = -1
+      end
+    ensure
+      Font.glyph_cache_limit = limit
+    end
+  end
+
+  def test_layout
+    font = Font.new("fonts/ORANGEKI", 12)
+    lines = font.layout("Hello")
+    assert lines.frozen?
+    assert_equal 1, lines.size
+    assert lines[0].frozen?
+    assert_equal "Hello", lines[0][0]
+    assert_equal 0, lines[0][1]
+    assert_equal 0, lines[0][2]
+    assert 0 < lines[0][3]
+    assert lines.equal?(font.layout("Hello"))
+    glyphs = font.glyph_cache_stats[:glyphs]
+    font.layout("Layouts render no glyphs")
+    assert_equal glyphs, font.glyph_cache_stats[:glyphs]
+    width = font.layout("aaa bbb")[0][3]
+    lines = font.layout("aaa bbb ccc", :width => width)
+    assert_equal ["aaa bbb", "ccc"], lines.map {|line| line[0] }
+    assert_equal font.layout("ccc")[0][3], lines[1][3]
+    line_height = lines[1][2]
+    assert 0 < line_height
+    lines = font.layout("aaa bbb ccc", :width => width, :line_spacing => 3)
+    assert_equal line_height + 3, lines[1][2]
+    lines = font.layout("aaa\nbbb ccc\n\nd")
+    assert_equal ["aaa", "bbb ccc", "", "d"], lines.map {|line| line[0] }
+    assert_equal [0, 1, 2, 3].map {|i| i * line_height },
+                 lines.map {|line| line[2] }
+    lines = font.layout("aaa\nbbb ccc", :align => :right)
+    assert_equal lines[1][3], lines[0][1] + lines[0][3]
+    assert_equal 0, lines[1][1]
+    lines = font.layout("aaa\nbbb ccc", :width => 200, :align => :center)
+    assert_equal (200 - lines[0][3]) / 2, lines[0][1]
+    lines = font.layout("abcdefgh", :width => 1)
+    assert_equal "abcdefgh".chars, lines.map {|line| line[0] }
+    assert_raise ArgumentError do
+      font.layout("a", :width => 0)
+    end
+    assert_raise ArgumentError do
+      font.layout("a", :align => :middle)
+    end
+    assert_raise TypeError do
+      font.layout(nil)
+    end
+    assert_raise TypeError do
+      font.layout("a", false)
+    end
+  end
+
 end
@@ -20,6 +20,10 @@ class TestGame < Test::Unit::TestCase
       assert_equal "", g.title
       assert_equal 30, g.fps
       assert_equal 1, g.window_scale
+      assert_equal 0, g.max_frame_skip
+      assert_equal false, g.frame_skipped?
+      assert_equal false, g.present_thread?
+      assert_equal false, g.direct_screen?
       assert_equal false, g.disposed?
     ensure
       if g
@@ -91,6 +95,12 @@ class TestGame < Test::Unit::TestCase
     assert_raise TypeError do
       Game.new(320, 240, :window_scale => false)
     end
+    assert_raise TypeError do
+      Game.new(320, 240, :max_frame_skip => false)
+    end
+    assert_raise ArgumentError do
+      Game.new(320, 240, :max_frame_skip => -1)
+    end
   end
 
   def test_dispose
@@ -107,6 +117,21 @@ class TestGame < Test::Unit::TestCase
     assert_raise RuntimeError do
       g.fullscreen?
     end
+    assert_raise RuntimeError do
+      g.frame_skipped?
+    end
+    assert_raise RuntimeError do
+      g.max_frame_skip
+    end
+    assert_raise RuntimeError do
+      g.present_thread?
+    end
+    assert_raise RuntimeError do
+      g.direct_screen?
+    end
+    assert_raise RuntimeError do
+      g.schedule_idle {}
+    end
     assert_raise RuntimeError do
       g.real_fps
     end
@@ -137,6 +162,12 @@ class TestGame < Test::Unit::TestCase
     assert_raise RuntimeError do
       g.window_scale = 2
     end
+    assert_raise RuntimeError do
+      g.screen_effects
+    end
+    assert_raise RuntimeError do
+      g.screen_effects = {:brightness => 128}
+    end
   ensure
     g.dispose if g
   end
@@ -170,6 +201,177 @@ class TestGame < Test::Unit::TestCase
     assert_nil Game.current
   end
 
+  def test_run_frame_skip
+    count = 0
+    Game.run(320, 240, :fps => 100, :max_frame_skip => 2) do |game|
+      assert_equal 2, game.max_frame_skip
+      if count == 0
+        game.max_frame_skip = 2 ** 30
+        assert_equal 60, game.max_frame_skip
+        game.max_frame_skip = 2
+      end
+      stats = game.frame_skip_stats
+      assert stats.frozen?
+      assert stats[:consecutive] <= 2
+      count += 1
+      if count == 10
+        assert 0 < stats[:skipped]
+        assert_equal count - 1, stats[:skipped] + stats[:rendered]
+        break
+      end
+      sleep 0.03
+    end
+    Game.run(320, 240, :fps => 100) do |game|
+      count += 1
+      sleep 0.03
+      assert_equal false, game.frame_skipped?
+      break if count == 15
+    end
+  end
+
+  def test_run_present_thread
+    count = 0
+    Game.run(320, 240, :present_thread => true) do |game|
+      assert game.present_thread?
+      assert_raise StarRubyError do
+        game.screen.view(0, 0, 10, 10)
+      end
+      game.screen.fill(Color.new(255, 0, 0))
+      count += 1
+      game.window_scale = 2 if count == 3
+      break if count == 5
+    end
+    assert_nil Game.current
+  end
+
+  def test_run_direct_screen
+    count = 0
+    Game.run(320, 240, :direct_screen => true,
+             :present_thread => true) do |game|
+      assert game.direct_screen?
+      assert_equal false, game.present_thread?
+      game.screen.fill(Color.new(255, 0, 0, 128))
+      count += 1
+      game.window_scale = 2 if count == 2
+      break if count == 3
+    end
+    assert_nil Game.current
+  end
+
+  def test_schedule_idle
+    g = nil
+    begin
+      g = Game.new(320, 240, :fps => 50)
+      assert_equal 0, g.idle_task_count
+      budgets = []
+      task = g.schedule_idle do |budget|
+        budgets << budget
+        budgets.size < 3
+      end
+      assert_kind_of Proc, task
+      other = g.schedule_idle { true }
+      assert_equal 2, g.idle_task_count
+      g.update_state
+      g.wait
+      g.update_state
+      g.wait
+      assert_equal 3, budgets.size
+      assert budgets.all? {|budget| 0 < budget and budget < 20 }
+      assert_equal 1, g.idle_task_count
+      assert_equal false, g.cancel_idle(task)
+      assert_equal true, g.cancel_idle(other)
+      assert_equal 0, g.idle_task_count
+      assert_raise LocalJumpError do
+        g.schedule_idle
+      end
+    ensure
+      g.dispose if g
+    end
+  end
+
+  def test_schedule_idle_dispose
+    g = nil
+    begin
+      g = Game.new(320, 240, :fps => 50)
+      g.schedule_idle { g.dispose; true }
+      g.update_state
+      g.wait
+      assert g.disposed?
+      assert_nil Game.current
+    ensure
+      g.dispose if g and !g.disposed?
+    end
+  end
+
+  def test_screen_effects
+    [{}, {:direct_screen => true}, {:present_thread => true}].each do |options|
+      g = nil
+      begin
+        g = Game.new(32, 24, options)
+        effects = g.screen_effects
+        assert effects.frozen?
+        assert_equal({:brightness => 255, :tone_red => 0, :tone_green => 0,
+                       :tone_blue => 0, :saturation => 255, :mosaic => 1,
+                       :color_matrix => nil}, effects)
+        g.screen.fill(StarRuby::Color.new(255, 128, 64, 128))
+        g.screen_effects = {:brightness => 128, :tone_red => -64,
+          :saturation => 0, :mosaic => 4,
+          :color_matrix => [0, 0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 16]}
+        effects = g.screen_effects
+        assert_equal 128, effects[:brightness]
+        assert_equal(-64, effects[:tone_red])
+        assert_equal 0, effects[:tone_green]
+        assert_equal 0, effects[:saturation]
+        assert_equal 4, effects[:mosaic]
+        assert_equal [0.0, 0.0, 1.0, 0.0, 0.0, 1.0, 0.0, 0.0, 1.0, 0.0, 0.0, 16.0],
+          effects[:color_matrix]
+        assert effects[:color_matrix].frozen?
+        g.update_screen
+        g.update_screen
+        g.screen_effects = {:tone_blue => 255}
+        assert_equal 255, g.screen_effects[:brightness]
+        assert_equal 255, g.screen_effects[:tone_blue]
+        g.update_screen
+        g.screen_effects = nil
+        assert_equal 0, g.screen_effects[:tone_blue]
+        g.update_screen
+      ensure
+        g.dispose if g
+      end
+    end
+  end
+
+  def test_screen_effects_type
+    g = nil
+    begin
+      g = Game.new(32, 24)
+      assert_raise ArgumentError do
+        g.screen_effects = {:brightness => 256}
+      end
+      assert_raise ArgumentError do
+        g.screen_effects = {:tone_red => -256}
+      end
+      assert_raise ArgumentError do
+        g.screen_effects = {:mosaic => 0}
+      end
+      assert_raise ArgumentError do
+        g.screen_effects = {:color_matrix => [1, 0, 0]}
+      end
+      assert_raise TypeError do
+        g.screen_effects = {:saturation => "255"}
+      end
+      assert_raise TypeError do
+        g.screen_effects = {:color_matrix => 1}
+      end
+      assert_raise TypeError do
+        g.screen_effects = 1
+      end
+      assert_equal 255, g.screen_effects[:brightness]
+    ensure
+      g.dispose if g
+    end
+  end
+
   def test_run_window_scale
     Game.run(320, 240, :window_scale => 2) do |game|
       assert_equal [320, 240], game.screen.size
@@ -26,6 +26,155 @@ class TestInput < Test::Unit::TestCase
     end
   end
   
+  def test_keys_cache
+    keys = Input.keys(:keyboard)
+    assert keys.frozen?
+    assert_same keys, Input.keys(:keyboard)
+    assert_same keys, Input.keys(:keyboard, {})
+    assert_not_same keys, Input.keys(:mouse)
+    assert_not_same keys, Input.keys(:keyboard, :duration => 1)
+  end
+
+  def test_pressed
+    [:a, :z, :d0, :f1, :numpad9, :space, :up].each do |key|
+      assert_equal Input.keys(:keyboard).include?(key),
+                   Input.pressed?(:keyboard, key)
+      assert_equal Input.keys(:keyboard, :duration => 1).include?(key),
+                   Input.pressed?(:keyboard, key, :duration => 1)
+    end
+    assert_equal false, Input.pressed?(:keyboard, :foo)
+    assert_equal false, Input.pressed?(:mouse, :left, :duration => 0)
+    assert_equal false, Input.pressed?(:gamepad, 1, :device_number => 100)
+    assert_raise ArgumentError do
+      Input.pressed?(:foo, :a)
+    end
+    assert_raise TypeError do
+      Input.pressed?(:keyboard, :a, false)
+    end
+    [:device_number, :duration, :delay, :interval].each do |key|
+      assert_raise TypeError do
+        Input.pressed?(:gamepad, :up, key => false)
+      end
+    end
+  end
+
+  def test_events
+    [:keyboard, :gamepad, :mouse].each do |device|
+      events = Input.events(device)
+      assert_kind_of Array, events
+      assert events.frozen?
+    end
+    assert_equal [], Input.events(:gamepad, :device_number => 100)
+    assert_raise TypeError do
+      Input.events(nil)
+    end
+    assert_raise ArgumentError do
+      Input.events(:foo)
+    end
+    assert_raise TypeError do
+      Input.events(:keyboard, false)
+    end
+    assert_raise TypeError do
+      Input.events(:gamepad, :device_number => false)
+    end
+  end
+
+  def test_record_and_replay
+    path = "input_record_test"
+    gamepad_count = Input.gamepad_count
+    begin
+      assert_equal false, Input.recording?
+      Input.record(path)
+      assert Input.recording?
+      Input.stop_recording
+      assert_equal false, Input.recording?
+      assert_equal "SRIN\x01", File.binread(path)[0, 5]
+      Input.replay(path)
+      assert Input.replaying?
+      assert_equal gamepad_count, Input.gamepad_count
+      Input.stop_replay
+      assert_equal false, Input.replaying?
+      File.binwrite(path, "foo")
+      assert_raise ArgumentError do
+        Input.replay(path)
+      end
+      assert_equal false, Input.replaying?
+    ensure
+      Input.stop_recording
+      Input.stop_replay
+      File.delete(path) if File.exist?(path)
+    end
+    assert_raise Errno::ENOENT do
+      Input.replay("not_exist/input")
+    end
+    assert_raise Errno::ENOENT do
+      Input.record("not_exist/input")
+    end
+    assert_raise TypeError do
+      Input.record(nil)
+    end
+  end
+
+  def test_record_and_replay_frames
+    path = "input_record_test"
+    game = Game.new(32, 24)
+    begin
+      Input.record(path)
+      recorded = []
+      3.times do
+        game.update_state
+        recorded << Input.keys(:keyboard)
+      end
+      Input.stop_recording
+      # The header, a full first frame and a repeat tag for each other frame
+      header_size = 7 + Input.gamepad_count
+      data = File.binread(path)
+      frame_size = data.size - header_size - 3
+      assert 5 < frame_size
+      assert_equal 1, data.getbyte(header_size)
+      assert_equal 0, data.getbyte(header_size + 1 + frame_size)
+      assert_equal 0, data.getbyte(header_size + 2 + frame_size)
+      Input.replay(path)
+      recorded.each do |keys|
+        game.update_state
+        assert Input.replaying?
+        assert_equal keys, Input.keys(:keyboard)
+      end
+      game.update_state
+      assert_equal false, Input.replaying?
+
+      # The first key alone, repeated by a tag of 0, then released
+      pressed = "\x01" + "\x00" * (frame_size - 1)
+      released = "\x00" * frame_size
+      File.binwrite(path, data[0, header_size] + "\x01" + pressed +
+                    "\x00" + "\x01" + released)
+      Input.replay(path)
+      game.update_state
+      keys = Input.keys(:keyboard)
+      assert_equal 1, keys.size
+      assert_equal keys, Input.keys(:keyboard, :duration => 1)
+      game.update_state
+      assert_equal keys, Input.keys(:keyboard)
+      assert_equal [], Input.keys(:keyboard, :duration => 1)
+      game.update_state
+      assert_equal [], Input.keys(:keyboard)
+      assert Input.replaying?
+      game.update_state
+      assert_equal false, Input.replaying?
+
+      # A frame cut short ends the replay
+      File.binwrite(path, data[0, header_size] + "\x01" + pressed[0, 1])
+      Input.replay(path)
+      game.update_state
+      assert_equal false, Input.replaying?
+    ensure
+      Input.stop_recording
+      Input.stop_replay
+      File.delete(path) if File.exist?(path)
+      game.dispose
+    end
+  end
+
   def test_mouse_location
     assert_kind_of Array, Input.mouse_location
     assert_equal 2, Input.mouse_location.size
@@ -10,4 +10,87 @@ class TestStarRuby < Test::Unit::TestCase
     assert StarRuby::VERSION.frozen?
   end
 
+  def test_buffer_pool
+    limit = StarRuby.buffer_pool_limit
+    GC.start
+    GC.disable
+    begin
+      StarRuby.buffer_pool_limit = 1024 * 1024
+      assert_equal 1024 * 1024, StarRuby.buffer_pool_limit
+      StarRuby.trim_buffer_pool
+      assert_equal 0, StarRuby.buffer_pool_stats[:pooled_bytes]
+      stats = StarRuby.buffer_pool_stats
+      assert stats.frozen?
+      texture = StarRuby::Texture.new(100, 100)
+      texture.dispose
+      assert_equal 1, StarRuby.buffer_pool_stats[:pooled_buffers]
+      assert 100 * 100 * 4 <= StarRuby.buffer_pool_stats[:pooled_bytes]
+      hits = StarRuby.buffer_pool_stats[:hits]
+      texture = StarRuby::Texture.new(100, 100)
+      assert_equal hits + 1, StarRuby.buffer_pool_stats[:hits]
+      assert_equal 0, StarRuby.buffer_pool_stats[:pooled_buffers]
+      texture.height.times do |j|
+        texture.width.times do |i|
+          assert_equal StarRuby::Color.new(0, 0, 0, 0), texture[i, j]
+        end
+      end
+      texture.dispose
+      texture = StarRuby::Texture.new(1000, 1000)
+      texture.dispose
+      assert_equal 1, StarRuby.buffer_pool_stats[:pooled_buffers]
+      assert 0 < StarRuby.trim_buffer_pool
+      assert_equal 0, StarRuby.buffer_pool_stats[:pooled_buffers]
+      assert_equal 0, StarRuby.buffer_pool_stats[:pooled_bytes]
+      assert_raise ArgumentError do
+        StarRuby.buffer_pool_limit = -1
+      end
+      assert_raise ArgumentError do
+        StarRuby.trim_buffer_pool(-1)
+      end
+    ensure
+      GC.enable
+      StarRuby.buffer_pool_limit = limit
+    end
+  end
+
+  def test_path_cache
+    StarRuby.clear_path_cache
+    stats = StarRuby.path_cache_stats
+    assert stats.frozen?
+    assert_equal 0, stats[:entries]
+    texture = StarRuby::Texture.load("images/ruby")
+    assert_equal stats[:misses] + 1, StarRuby.path_cache_stats[:misses]
+    assert_equal 1, StarRuby.path_cache_stats[:entries]
+    texture2 = StarRuby::Texture.load("images/ruby")
+    assert_equal stats[:hits] + 1, StarRuby.path_cache_stats[:hits]
+    assert_equal texture.width, texture2.width
+    assert_raise ArgumentError do
+      StarRuby::Texture.load("images/ambiguous")
+    end
+    assert_raise ArgumentError do
+      StarRuby::Texture.load("images/ambiguous")
+    end
+    assert_raise Errno::ENOENT do
+      StarRuby::Texture.load("images/not_exist")
+    end
+    assert 1 <= StarRuby.clear_path_cache
+    assert_equal 0, StarRuby.path_cache_stats[:entries]
+    if StarRuby.path_cache_stats[:watching]
+      path = "images/path_cache_test"
+      begin
+        assert_raise Errno::ENOENT do
+          StarRuby::Texture.load(path)
+        end
+        invalidations = StarRuby.path_cache_stats[:invalidations]
+        File.open("images/ruby.png", "rb") do |src|
+          File.open(path + ".png", "wb") {|dst| dst.write(src.read) }
+        end
+        assert_equal texture.width, StarRuby::Texture.load(path).width
+        assert invalidations < StarRuby.path_cache_stats[:invalidations]
+      ensure
+        File.delete(path + ".png") if File.exist?(path + ".png")
+      end
+    end
+  end
+
 end
@@ -1142,6 +1142,100 @@ class TestTexture < Test::Unit::TestCase
     end
   end
   
+  def test_render_text_effects
+    font = Font.new("fonts/ORANGEKI", 12)
+    color = Color.new(10, 20, 30)
+    shadow_color = Color.new(200, 100, 0, 128)
+    outline_color = Color.new(255, 255, 0)
+    base = Texture.new(50, 40)
+    base.fill(Color.new(90, 150, 210))
+    texture1 = base.clone
+    texture1.render_text("I", 10, 10, font, color,
+                         :shadow => [shadow_color, 2, -3], :anti_alias => true)
+    texture2 = base.clone
+    texture2.render_text("I", 12, 7, font, shadow_color, true)
+    texture2.render_text("I", 10, 10, font, color, true)
+    assert_equal texture2.dump("rgba"), texture1.dump("rgba")
+    # Shadows far away cost nothing and may land back on the texture
+    [[20000, 20000], [2 ** 31 - 1, -2 ** 31]].each do |dx, dy|
+      texture1 = base.clone
+      texture1.render_text("I", 10, 10, font, color,
+                           :shadow => [shadow_color, dx, dy])
+      texture2 = base.clone
+      texture2.render_text("I", 10, 10, font, color)
+      assert_equal texture2.dump("rgba"), texture1.dump("rgba")
+    end
+    texture1 = base.clone
+    texture1.render_text("I", -30000, 10, font, color,
+                         :shadow => [shadow_color, 30012, -3], :anti_alias => true)
+    texture2 = base.clone
+    texture2.render_text("I", 12, 7, font, shadow_color, true)
+    assert_equal texture2.dump("rgba"), texture1.dump("rgba")
+    texture1 = base.clone
+    texture1.render_text("I", 10, 10, font, color, true, :outline => [outline_color, 0])
+    texture2 = base.clone
+    texture2.render_text("I", 10, 10, font, color, true)
+    assert_equal texture2.dump("rgba"), texture1.dump("rgba")
+    texture1 = Texture.new(50, 40)
+    texture1.render_text("I", 10, 10, font, color, false,
+                         :outline => [outline_color, 1])
+    texture2 = Texture.new(50, 40)
+    texture2.render_text("I", 10, 10, font, color, false)
+    grown = false
+    (1...39).each do |j|
+      (1...49).each do |i|
+        if 0 < texture2[i, j].alpha
+          assert 0 < texture1[i, j].alpha
+          assert_equal 255, texture1[i - 1, j].alpha
+          assert_equal 255, texture1[i, j + 1].alpha
+        elsif 0 < texture1[i, j].alpha
+          assert_equal outline_color, texture1[i, j]
+          grown = true
+        end
+      end
+    end
+    assert grown
+    assert_raise TypeError do
+      texture1.render_text("I", 0, 0, font, color, false, :outline => outline_color)
+    end
+    assert_raise ArgumentError do
+      texture1.render_text("I", 0, 0, font, color, false, :outline => [outline_color])
+    end
+    assert_raise ArgumentError do
+      texture1.render_text("I", 0, 0, font, color, false, :outline => [outline_color, -1])
+    end
+    assert_raise ArgumentError do
+      texture1.render_text("I", 0, 0, font, color, false, :shadow => [shadow_color, 1])
+    end
+    assert_raise TypeError do
+      texture1.render_text("I", 0, 0, font, color, false, false)
+    end
+  end
+
+  def test_render_text_block
+    font = Font.new("fonts/ORANGEKI", 12)
+    color = Color.new(10, 20, 30)
+    texture = Texture.new(100, 100)
+    texture.render_text_block("aaa bbb\nccc", 5, 6, font, color,
+                              :width => 60, :align => :right,
+                              :anti_alias => true)
+    texture2 = Texture.new(100, 100)
+    font.layout("aaa bbb\nccc", :width => 60, :align => :right).each do |line|
+      texture2.render_text(line[0], 5 + line[1], 6 + line[2], font, color, true)
+    end
+    assert_equal texture2.dump("rgba"), texture.dump("rgba")
+    texture.freeze
+    assert_raise FrozenError do
+      texture.render_text_block("a", 0, 0, font, color)
+    end
+    assert_raise TypeError do
+      texture2.render_text_block(nil, 0, 0, font, color)
+    end
+    assert_raise TypeError do
+      texture2.render_text_block("a", 0, 0, nil, color)
+    end
+  end
+
   def test_render_text_disposed
     texture = Texture.load("images/ruby")
     if Font.exist?("Arial")
@@ -1543,6 +1637,291 @@ class TestTexture < Test::Unit::TestCase
     end
   end
 
+  def test_scroll
+    orig = Texture.load("images/ruby")
+    w, h = orig.size
+    [[0, 0], [5, 0], [-5, 0], [0, 7], [0, -7],
+     [5, 7], [-5, 7], [5, -7], [-5, -7]].each do |dx, dy|
+      texture = orig.clone
+      rects = texture.scroll!(dx, dy)
+      assert rects.frozen?
+      h.times do |j|
+        w.times do |i|
+          if 0 <= i - dx and i - dx < w and 0 <= j - dy and j - dy < h
+            assert_equal orig[i - dx, j - dy], texture[i, j]
+          end
+        end
+      end
+      expected = []
+      expected << [0, dy > 0 ? 0 : h + dy, w, dy.abs] if dy != 0
+      expected << [dx > 0 ? 0 : w + dx, [dy, 0].max, dx.abs, h - dy.abs] if dx != 0
+      assert_equal expected, rects
+      exposed = rects.inject(0) {|sum, r| sum + r[2] * r[3] }
+      assert_equal w * h - (w - dx.abs) * (h - dy.abs), exposed
+    end
+    texture = orig.clone
+    color = Color.new(1, 2, 3, 4)
+    rects = texture.scroll!(-3, 4, :fill => color)
+    assert_equal [[0, 0, w, 4], [w - 3, 4, 3, h - 4]], rects
+    w.times {|i| assert_equal color, texture[i, 0] }
+    assert_equal color, texture[w - 1, h - 1]
+    assert_equal orig[3, 0], texture[0, 4]
+    texture = orig.clone
+    assert_equal [[0, 0, w, h]], texture.scroll!(w, 0, :fill => color)
+    assert_equal color, texture[w - 1, h - 1]
+    view = texture.view(10, 10, 20, 20)
+    view.fill(Color.new(0, 0, 0, 0))
+    view[0, 0] = Color.new(9, 9, 9, 9)
+    view.scroll!(1, 1)
+    assert_equal Color.new(9, 9, 9, 9), texture[11, 11]
+    assert_equal color, texture[9, 9]
+    assert_equal color, texture[30, 30]
+  end
+
+  def test_scroll_frozen
+    texture = Texture.load("images/ruby")
+    texture.freeze
+    assert_raise FrozenError do
+      texture.scroll!(1, 1)
+    end
+  end
+
+  def test_scroll_disposed
+    texture = Texture.load("images/ruby")
+    texture.dispose
+    assert_raise RuntimeError do
+      texture.scroll!(1, 1)
+    end
+  end
+
+  def test_scroll_type
+    texture = Texture.load("images/ruby")
+    assert_raise TypeError do
+      texture.scroll!(nil, 1)
+    end
+    assert_raise TypeError do
+      texture.scroll!(1, nil)
+    end
+    assert_raise TypeError do
+      texture.scroll!(1, 1, false)
+    end
+    assert_raise TypeError do
+      texture.scroll!(1, 1, :fill => 1)
+    end
+  end
+
+  def test_alpha_only
+    texture = Texture.new(40, 30, :alpha_only => true)
+    assert texture.alpha_only?
+    assert !Texture.new(40, 30).alpha_only?
+    assert_equal [40, 30], texture.size
+    assert_equal Color.new(255, 255, 255, 0), texture[0, 0]
+    texture[1, 2] = Color.new(10, 20, 30, 40)
+    assert_equal Color.new(255, 255, 255, 40), texture[1, 2]
+    texture.fill_rect(10, 10, 5, 5, Color.new(0, 0, 0, 128))
+    assert_equal Color.new(255, 255, 255, 128), texture[14, 14]
+    assert_equal Color.new(255, 255, 255, 0), texture[15, 14]
+    texture2 = texture.clone
+    assert texture2.alpha_only?
+    assert_equal texture.dump("rgba"), texture2.dump("rgba")
+    assert_equal 40 * 30, texture.dump("a").size
+    texture2.clear
+    assert_equal Color.new(255, 255, 255, 0), texture2[14, 14]
+    texture2.fill(Color.new(0, 0, 0, 77))
+    assert_equal Color.new(255, 255, 255, 77), texture2[39, 29]
+    texture2.dispose
+    assert texture2.disposed?
+    assert_raise RuntimeError do
+      texture2[0, 0]
+    end
+    assert_raise StarRubyError do
+      texture.view(0, 0, 10, 10)
+    end
+    assert_raise StarRubyError do
+      texture.render_line(0, 0, 10, 10, Color.new(0, 0, 0))
+    end
+    assert_raise StarRubyError do
+      texture.render_texture(Texture.new(10, 10), 0, 0)
+    end
+    assert_raise StarRubyError do
+      texture.change_hue(1)
+    end
+    assert_raise TypeError do
+      Texture.new(10, 10, false)
+    end
+  end
+
+  def test_alpha_only_render_texture
+    alpha = Texture.new(40, 30, :alpha_only => true)
+    rgba = Texture.new(40, 30)
+    color = Color.new(200, 100, 50, 220)
+    30.times do |j|
+      40.times do |i|
+        a = (i * 7 + j * 13) % 256
+        alpha[i, j] = Color.new(0, 0, 0, a)
+        rgba[i, j] = Color.new(color.red, color.green, color.blue, a * 220 / 255)
+      end
+    end
+    base = Texture.load("images/ruby")
+    [{}, {:alpha => 100}, {:src_x => 3, :src_y => 4, :src_width => 20},
+     {:scale_x => 2, :angle => 0.5}, {:blend_type => :add},
+     {:tone_red => 50}].each do |options|
+      texture1 = base.clone
+      texture2 = base.clone
+      texture1.render_texture(alpha, 10, -5, options.merge(:color => color))
+      texture2.render_texture(rgba, 10, -5, options)
+      assert_equal texture2.dump("rgba"), texture1.dump("rgba")
+    end
+    [{}, {:scale_x => 2}].each do |options|
+      texture1 = base.clone
+      texture1.render_texture(alpha, 5, 5,
+                              options.merge(:blend_type => :mask))
+      texture2 = base.clone
+      30.times do |j|
+        40.times do |i|
+          texture2[i, j] = Color.new(alpha[i, j].alpha, 0, 0, 255)
+        end
+      end
+      texture3 = base.clone
+      texture3.render_texture(texture2, 5, 5,
+                              options.merge(:src_width => 40,
+                                            :src_height => 30,
+                                            :blend_type => :mask))
+      assert_equal texture3.dump("rgba"), texture1.dump("rgba")
+    end
+  end
+
+  def test_alpha_only_render_text
+    font = Font.new("fonts/ORANGEKI", 12)
+    alpha = Texture.new(100, 20, :alpha_only => true)
+    alpha.render_text("Hello", 2, 3, font, Color.new(255, 255, 255), true)
+    color = Color.new(10, 20, 30)
+    base = Texture.new(100, 20)
+    base.fill(Color.new(200, 150, 100))
+    texture1 = base.clone
+    texture1.render_texture(alpha, 0, 0, :color => color)
+    texture2 = base.clone
+    texture2.render_text("Hello", 2, 3, font, color, true)
+    assert_equal texture2.dump("rgba"), texture1.dump("rgba")
+  end
+
+  def test_view
+    texture = Texture.load("images/ruby")
+    view = texture.view(10, 20, 5, 6)
+    assert_equal [5, 6], view.size
+    view.height.times do |j|
+      view.width.times do |i|
+        assert_equal texture[i + 10, j + 20], view[i, j]
+      end
+    end
+    view.fill(Color.new(1, 2, 3, 4))
+    assert_equal Color.new(1, 2, 3, 4), texture[10, 20]
+    assert_equal Color.new(1, 2, 3, 4), texture[14, 25]
+    assert_not_equal Color.new(1, 2, 3, 4), texture[15, 25]
+    assert_not_equal Color.new(1, 2, 3, 4), texture[14, 26]
+    view.render_rect(-1, -1, 100, 100, Color.new(11, 12, 13))
+    assert_equal Color.new(11, 12, 13), texture[14, 25]
+    assert_not_equal Color.new(11, 12, 13), texture[9, 19]
+    view2 = view.view(1, 1, 2, 2)
+    view2[0, 0] = Color.new(5, 6, 7, 8)
+    assert_equal Color.new(5, 6, 7, 8), texture[11, 21]
+    assert_equal Color.new(5, 6, 7, 8), view[1, 1]
+    dumped = view.dump("rgba")
+    assert_equal 5 * 6 * 4, dumped.length
+    clone = view.clone
+    assert_equal view.size, clone.size
+    assert_equal dumped, clone.dump("rgba")
+    clone.clear
+    assert_equal Color.new(5, 6, 7, 8), view[1, 1]
+    view.clear
+    assert_equal Color.new(0, 0, 0, 0), texture[10, 20]
+    assert_not_equal Color.new(0, 0, 0, 0), texture[15, 20]
+  end
+
+  def test_view_render_texture
+    texture = Texture.new(8, 8)
+    src = Texture.new(4, 4)
+    src.fill(Color.new(255, 0, 0))
+    view = texture.view(2, 2, 4, 4)
+    view.render_texture(src, 2, 2)
+    assert_equal Color.new(255, 0, 0), texture[4, 4]
+    assert_equal Color.new(255, 0, 0), texture[5, 5]
+    assert_equal Color.new(0, 0, 0, 0), texture[6, 6]
+    assert_equal Color.new(0, 0, 0, 0), texture[3, 3]
+    view.render_texture(texture.view(4, 4, 2, 2), 0, 0, :scale_x => 1, :angle => 0.0)
+    assert_equal Color.new(255, 0, 0), texture[2, 2]
+    assert_equal Color.new(255, 0, 0), texture[3, 3]
+  end
+
+  def test_view_render_side_by_side
+    texture = Texture.new(16, 8)
+    left  = texture.view(0, 0, 8, 8)
+    right = texture.view(8, 0, 8, 8)
+    left.fill(Color.new(0, 0, 255))
+    right.render_in_perspective(left, :camera_height => 100)
+    lower = texture.view(2, 4, 4, 4)
+    upper = texture.view(10, 0, 4, 4)
+    upper.render_in_perspective(lower, :camera_height => 100)
+    assert_raise RuntimeError do
+      texture.view(4, 2, 8, 4).render_in_perspective(lower)
+    end
+    assert_raise RuntimeError do
+      texture.view(5, 7, 4, 1).render_in_perspective(lower)
+    end
+    right.fill(Color.new(0, 0, 0, 0))
+    right.render_texture(left, 0, 0)
+    assert_equal Color.new(0, 0, 255), texture[8, 0]
+    assert_equal Color.new(0, 0, 255), texture[15, 7]
+  end
+
+  def test_view_frozen
+    texture = Texture.new(8, 8)
+    texture.freeze
+    assert_raise FrozenError do
+      texture.view(0, 0, 4, 4).fill(Color.new(1, 2, 3))
+    end
+  end
+
+  def test_view_disposed
+    texture = Texture.new(8, 8)
+    view = texture.view(0, 0, 4, 4)
+    view.dispose
+    assert_equal true, view.disposed?
+    assert_equal false, texture.disposed?
+    view = texture.view(0, 0, 4, 4)
+    texture.dispose
+    assert_equal true, view.disposed?
+    assert_raise RuntimeError do
+      view.width
+    end
+    assert_raise RuntimeError do
+      texture.view(0, 0, 4, 4)
+    end
+  end
+
+  def test_view_invalid
+    texture = Texture.new(8, 8)
+    assert_raise ArgumentError do
+      texture.view(-1, 0, 4, 4)
+    end
+    assert_raise ArgumentError do
+      texture.view(0, 0, 9, 4)
+    end
+    assert_raise ArgumentError do
+      texture.view(4, 4, 5, 4)
+    end
+    assert_raise ArgumentError do
+      texture.view(0, 0, 0, 4)
+    end
+    assert_raise TypeError do
+      texture.view(nil, 0, 4, 4)
+    end
+    texture = Texture.load("images/ruby8", :palette => true)
+    assert_raise StarRubyError do
+      texture.view(0, 0, 4, 4)
+    end
+  end
+
   def test_returning_self
     texture = Texture.load("images/ruby.png")
     assert_equal texture, texture.clear
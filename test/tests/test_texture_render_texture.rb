@@ -784,6 +784,102 @@ class TestTextureRenderTexture < Test::Unit::TestCase
     end
   end
 
+  def test_render_texture_hue
+    texture = Texture.load("images/ruby")
+    texture2 = Texture.new(texture.width, texture.height)
+    texture2.render_texture(texture, 0, 0, :hue => 0)
+    texture3 = Texture.new(texture.width, texture.height)
+    texture3.render_texture(texture, 0, 0)
+    assert_equal texture3.dump("rgba"), texture2.dump("rgba")
+    texture2.clear
+    texture2.render_texture(texture, 0, 0, :hue => Math::PI * 2,
+                            :blend_type => :none)
+    texture2.height.times do |j|
+      texture2.width.times do |i|
+        p1 = texture[i, j]
+        p2 = texture2[i, j]
+        assert_in_delta p1.red,   p2.red,   1
+        assert_in_delta p1.green, p2.green, 1
+        assert_in_delta p1.blue,  p2.blue,  1
+        assert_equal p1.alpha, p2.alpha
+      end
+    end
+    # Primary colors turn roughly as change_hue does
+    colors = Texture.new(3, 1)
+    colors[0, 0] = Color.new(255, 0, 0)
+    colors[1, 0] = Color.new(0, 255, 0)
+    colors[2, 0] = Color.new(0, 0, 255)
+    [Math::PI * 2 / 3, Math::PI * 4 / 3].each do |angle|
+      expected = colors.change_hue(angle)
+      texture4 = Texture.new(3, 1)
+      texture4.render_texture(colors, 0, 0, :hue => angle)
+      3.times do |i|
+        e = expected[i, 0]
+        c = texture4[i, 0]
+        assert_equal 255, c.alpha
+        [:red, :green, :blue].each do |channel|
+          if e.send(channel) == 255
+            assert [:red, :green, :blue].all? {|other| c.send(other) <= c.send(channel) }
+          end
+        end
+      end
+    end
+    assert_raise TypeError do
+      texture2.render_texture(texture, 0, 0, :hue => "1")
+    end
+  end
+
+  def test_render_texture_color_and_blend
+    texture = Texture.load("images/ruby")
+    base = Texture.new(texture.width, texture.height)
+    base.height.times do |j|
+      base.width.times do |i|
+        base[i, j] = Color.new(i * 4 % 256, j * 4 % 256, 128, (i + j) * 8 % 256)
+      end
+    end
+    colors = {:tone_red => 40, :tone_blue => -90, :saturation => 100, :hue => 1}
+    toned = Texture.new(texture.width, texture.height)
+    toned.render_texture(texture, 0, 0, colors.merge(:blend_type => :none))
+    [:none, :alpha, :add, :sub].each do |blend_type|
+      [255, 128].each do |alpha|
+        options = {:blend_type => blend_type, :alpha => alpha, :angle => 0.25}
+        texture1 = base.clone
+        texture1.render_texture(texture, 3, 2, options.merge(colors))
+        texture2 = base.clone
+        texture2.render_texture(toned, 3, 2, options)
+        assert_equal texture2.dump("rgba"), texture1.dump("rgba")
+      end
+    end
+  end
+
+  def test_render_texture_color_rgba
+    texture = Texture.load("images/ruby")
+    color = Color.new(200, 100, 50, 220)
+    tinted = Texture.new(texture.width, texture.height)
+    texture.height.times do |j|
+      texture.width.times do |i|
+        p = texture[i, j]
+        tinted[i, j] = Color.new(p.red * 200 / 255, p.green * 100 / 255,
+                                 p.blue * 50 / 255, p.alpha * 220 / 255)
+      end
+    end
+    base = Texture.load("images/ruby")
+    [{}, {:alpha => 100}, {:src_x => 3, :src_y => 4, :src_width => 20},
+     {:blend_type => :none}, {:blend_type => :add}, {:blend_type => :sub},
+     {:scale_x => 2, :angle => 0.5}, {:tone_red => 50}].each do |options|
+      texture1 = base.clone
+      texture1.render_texture(texture, 10, -5, options.merge(:color => color))
+      texture2 = base.clone
+      texture2.render_texture(tinted, 10, -5, options)
+      assert_equal texture2.dump("rgba"), texture1.dump("rgba")
+    end
+    texture1 = base.clone
+    texture1.render_texture(texture1, 7, 3, :color => color)
+    texture2 = base.clone
+    texture2.render_texture(tinted, 7, 3)
+    assert_equal texture2.dump("rgba"), texture1.dump("rgba")
+  end
+
   def test_render_texture_self
     texture = Texture.load("images/ruby")
     texture2 = Texture.new(texture.width, texture.height)
@@ -813,4 +909,27 @@ class TestTextureRenderTexture < Test::Unit::TestCase
     end
   end
 
+  def test_render_texture_self_overlap
+    texture = Texture.load("images/ruby")
+    [[10, 10], [-10, -10], [10, -10], [-10, 10],
+     [3, 0], [-3, 0], [0, 3], [0, -3]].each do |x, y|
+      [{}, {:blend_type => :none}, {:alpha => 128},
+       {:src_x => 5, :src_y => 4, :src_width => 30, :src_height => 20},
+       {:scale_x => 2}, {:blend_type => :add}, {:blend_type => :sub},
+       {:blend_type => :sub, :alpha => 100}, {:blend_type => :mask}].each do |options|
+        texture2 = texture.clone
+        texture3 = texture.clone
+        texture2.render_texture(texture2, x, y, options)
+        texture3.render_texture(texture.clone, x, y, options)
+        assert_equal texture3.dump("rgba"), texture2.dump("rgba")
+      end
+    end
+    view = texture.view(0, 0, 40, 40)
+    texture2 = texture.clone
+    view.render_texture(texture, 5, 7)
+    texture2.render_texture(texture2.clone, 5, 7,
+                            :src_width => 35, :src_height => 33)
+    assert_equal texture2.dump("rgba"), texture.dump("rgba")
+  end
+
 end